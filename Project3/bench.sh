@@ -0,0 +1,24 @@
+#!/bin/sh
+# Generates synthetic traces in bench/ and reports, for each one, the speed, page faults
+# and TLB hit rate of part1 and of part2 with every replacement policy.
+# BENCH_COUNT sets the trace length (default 4000000 addresses).
+
+COUNT=${BENCH_COUNT:-4000000}
+mkdir -p bench
+
+for dist in uniform zipf seq loop phases; do
+	# the length is in the name, so a changed BENCH_COUNT makes a new trace
+	trace=bench/$dist-$COUNT.bin
+	[ -f $trace ] && [ -z "$BENCH_REGENERATE" ] || ./tracegen $trace -d $dist -n $COUNT -v 20 -w 512 || exit 1
+
+	echo "== $dist ($COUNT addresses)"
+	start=$(date +%s%N)
+	./part1 BACKING_STORE.bin $trace -o stats > bench/part1.out || exit 1
+	end=$(date +%s%N)
+	awk -v ns=$((end - start)) -v n=$COUNT '
+		/^Page Faults =/ { faults = $4 }
+		/^TLB Hit Rate =/ { rate = $5 }
+		END { printf "part1: %.2f Mtrans/s (whole run), Page Faults = %s, TLB Hit Rate = %s\n", n / ns * 1000, faults, rate }
+	' bench/part1.out
+	./part2 BACKING_STORE.bin $trace -m sweep -p 0,1,2,3,4 -f 256 -j 1 | tail -n +2 || exit 1
+done
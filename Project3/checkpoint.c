@@ -0,0 +1,372 @@
+/**
+ * checkpoint.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+struct stream {
+	FILE *fp;
+	// a read came up short: the file is truncated or not a checkpoint
+	int short_read;
+};
+
+static void put(struct stream *s, const void *p, size_t n)
+{
+	if (n) fwrite(p, n, 1, s->fp);
+}
+
+static void get(struct stream *s, void *p, size_t n)
+{
+	if (n && !s->short_read && fread(p, n, 1, s->fp) != 1) s->short_read = 1;
+}
+
+static void put_tlb(struct stream *s, const struct tlb *t)
+{
+	put(s, t->asid, t->size * sizeof(int32_t));
+	put(s, t->logical, t->size * sizeof(int32_t));
+	put(s, t->physical, t->size * sizeof(int32_t));
+	put(s, t->valid, t->size * sizeof(int32_t));
+	put(s, t->stamp, t->size * sizeof(uint64_t));
+	put(s, &t->clock, sizeof(t->clock));
+	put(s, t->plru, t->size * sizeof(uint8_t));
+	put(s, t->fifo, t->sets * sizeof(int));
+	put(s, &t->rng, sizeof(t->rng));
+}
+
+static void get_tlb(struct stream *s, struct tlb *t)
+{
+	get(s, t->asid, t->size * sizeof(int32_t));
+	get(s, t->logical, t->size * sizeof(int32_t));
+	get(s, t->physical, t->size * sizeof(int32_t));
+	get(s, t->valid, t->size * sizeof(int32_t));
+	get(s, t->stamp, t->size * sizeof(uint64_t));
+	get(s, &t->clock, sizeof(t->clock));
+	get(s, t->plru, t->size * sizeof(uint8_t));
+	get(s, t->fifo, t->sets * sizeof(int));
+	get(s, &t->rng, sizeof(t->rng));
+}
+
+static void put_replacer(struct stream *s, const struct replacer *r)
+{
+	put(s, r->ref, r->frames * sizeof(uint8_t));
+	put(s, r->prev, r->frames * sizeof(int));
+	put(s, r->next, r->frames * sizeof(int));
+	put(s, &r->head, sizeof(r->head));
+	put(s, &r->tail, sizeof(r->tail));
+	put(s, &r->hand, sizeof(r->hand));
+	put(s, r->bucket_of, r->frames * sizeof(int));
+	put(s, r->buckets, (r->frames + 1) * sizeof(struct lfu_bucket));
+	put(s, &r->bucket_head, sizeof(r->bucket_head));
+	put(s, &r->bucket_free, sizeof(r->bucket_free));
+	put(s, &r->position, sizeof(r->position));
+	if (r->policy == REPLACE_OPT) {
+		put(s, r->key, r->frames * sizeof(uint64_t));
+		put(s, r->heap, r->frames * sizeof(int));
+		put(s, r->heap_pos, r->frames * sizeof(int));
+		put(s, &r->heap_len, sizeof(r->heap_len));
+	}
+}
+
+static void get_replacer(struct stream *s, struct replacer *r)
+{
+	get(s, r->ref, r->frames * sizeof(uint8_t));
+	get(s, r->prev, r->frames * sizeof(int));
+	get(s, r->next, r->frames * sizeof(int));
+	get(s, &r->head, sizeof(r->head));
+	get(s, &r->tail, sizeof(r->tail));
+	get(s, &r->hand, sizeof(r->hand));
+	get(s, r->bucket_of, r->frames * sizeof(int));
+	get(s, r->buckets, (r->frames + 1) * sizeof(struct lfu_bucket));
+	get(s, &r->bucket_head, sizeof(r->bucket_head));
+	get(s, &r->bucket_free, sizeof(r->bucket_free));
+	get(s, &r->position, sizeof(r->position));
+	if (r->policy == REPLACE_OPT) {
+		get(s, r->key, r->frames * sizeof(uint64_t));
+		get(s, r->heap, r->frames * sizeof(int));
+		get(s, r->heap_pos, r->frames * sizeof(int));
+		get(s, &r->heap_len, sizeof(r->heap_len));
+	}
+}
+
+struct leaf_writer {
+	struct stream *s;
+	size_t entries;
+	uint32_t leaves;
+};
+
+static void count_leaf(void *arg, uint32_t first_page, const int *leaf)
+{
+	(void)first_page;
+	(void)leaf;
+	((struct leaf_writer *)arg)->leaves++;
+}
+
+static void put_leaf(void *arg, uint32_t first_page, const int *leaf)
+{
+	struct leaf_writer *w = arg;
+	put(w->s, &first_page, sizeof(first_page));
+	put(w->s, leaf, w->entries * sizeof(int));
+}
+
+/* Every allocated leaf with its entries, so the restored table has the same nodes
+ * (and memory and walk lengths) as the saved one, not only the same mappings. */
+static void put_pagetable(struct stream *s, const struct pagetable *pt)
+{
+	struct leaf_writer w = {s, (size_t)1 << pt->bits[pt->levels - 1], 0};
+	pt_for_each_leaf(pt, count_leaf, &w);
+	put(s, &w.leaves, sizeof(w.leaves));
+	pt_for_each_leaf(pt, put_leaf, &w);
+}
+
+static int get_pagetable(struct stream *s, struct pagetable *pt, uint32_t virtual_pages)
+{
+	size_t entries = (size_t)1 << pt->bits[pt->levels - 1];
+	uint32_t leaves = 0;
+	get(s, &leaves, sizeof(leaves));
+	for (uint32_t i = 0; i < leaves && !s->short_read; i++) {
+		uint32_t first_page = 0;
+		get(s, &first_page, sizeof(first_page));
+		if (s->short_read) break;
+		if (first_page >= virtual_pages || (first_page & (entries - 1))) return -1;
+		get(s, pt_leaf(pt, first_page), entries * sizeof(int));
+	}
+	return 0;
+}
+
+int checkpoint_save(struct vm *vm, const char *path, const uint64_t *state, int n, int store)
+{
+	const struct vm_config *c = &vm->config;
+	// the frames being read have to hold their pages before they are copied out
+	if (c->io_depth) {
+		for (int frame = 0; frame < c->frames; frame++) {
+			if (vm->io_slot[frame] >= 0) vm_io_wait(vm, frame);
+		}
+	}
+
+	size_t len = strlen(path);
+	char *tmp = malloc(len + 5);
+	if (tmp == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".tmp", 5);
+	FILE *fp = fopen(tmp, "wb");
+	if (fp == NULL) {
+		free(tmp);
+		return -1;
+	}
+	struct stream s = {fp, 0};
+
+	put(&s, CHECKPOINT_MAGIC, 8);
+	put(&s, c, sizeof(*c));
+	put(&s, &n, sizeof(n));
+	put(&s, state, n * sizeof(uint64_t));
+
+	put(&s, &vm->stats, sizeof(vm->stats));
+	put(&s, &vm->asid, sizeof(vm->asid));
+	put(&s, &vm->free_page, sizeof(vm->free_page));
+	put(&s, &vm->flag, sizeof(vm->flag));
+	for (int i = 0; i < c->address_spaces; i++) {
+		const struct vm_space *space = &vm->space[i];
+		put(&s, &space->stats, sizeof(space->stats));
+		put(&s, &space->last_fault, sizeof(space->last_fault));
+		put(&s, &space->fault_stride, sizeof(space->fault_stride));
+		if (c->superpage_bits) {
+			size_t regions = vm->virtual_pages >> c->superpage_bits;
+			put(&s, space->resident, regions * sizeof(uint16_t));
+			put(&s, space->superpage, regions * sizeof(uint8_t));
+		}
+		put_pagetable(&s, &space->pt);
+	}
+
+	put(&s, vm->frame_owner, c->frames * sizeof(int));
+	put(&s, vm->frame_asid, c->frames * sizeof(int));
+	put(&s, vm->dirty, c->frames * sizeof(uint8_t));
+	put(&s, vm->prefetched, c->frames * sizeof(uint8_t));
+	// zero-copy frames point into the file and are pointed there again on restore
+	if (!c->zero_copy) put(&s, vm->main_memory, (size_t)c->frames * vm->page_size);
+	put(&s, &vm->wb_count, sizeof(vm->wb_count));
+	put(&s, vm->wb_pages, vm->wb_count * sizeof(int));
+	put(&s, vm->wb_data, (size_t)vm->wb_count * vm->page_size);
+
+	put_tlb(&s, &vm->tlb);
+	if (c->l2_size) put_tlb(&s, &vm->l2);
+	put_replacer(&s, &vm->replacer);
+	put(&s, &store, sizeof(store));
+	if (store) {
+		const struct backing_store *b = vm->store;
+		put(&s, &b->size, sizeof(b->size));
+		put(&s, &b->write_back, sizeof(b->write_back));
+		if (b->write_back) {
+			// pages written after the checkpoint change the file too, so all of it is needed to undo them
+			put(&s, b->data, b->size);
+		} else {
+			// the private copy only differs from the file in the pages written back to it
+			uint32_t pages = b->size / vm->page_size, written = 0;
+			for (uint32_t page = 0; page < pages; page++) written += vm->store_written[page];
+			put(&s, &written, sizeof(written));
+			for (uint32_t page = 0; page < pages; page++) {
+				if (!vm->store_written[page]) continue;
+				put(&s, &page, sizeof(page));
+				put(&s, b->data + (size_t)page * vm->page_size, vm->page_size);
+			}
+		}
+	}
+
+	int failed = fflush(fp) != 0 || ferror(fp) || fsync(fileno(fp)) != 0;
+	int saved = errno;
+	if (fclose(fp) != 0 && !failed) {
+		failed = 1;
+		saved = errno;
+	}
+	// the previous checkpoint stays in place until the new one is complete
+	if (!failed && rename(tmp, path) != 0) {
+		failed = 1;
+		saved = errno;
+	}
+	if (failed) unlink(tmp);
+	free(tmp);
+	errno = saved;
+	return failed ? -1 : 0;
+}
+
+/* Whether a checkpoint made with saved can be resumed with config. */
+static int compatible(const struct vm_config *saved, const struct vm_config *config)
+{
+	return saved->offset_bits == config->offset_bits && saved->virtual_bits == config->virtual_bits
+		&& saved->physical_bits == config->physical_bits && saved->frames == config->frames
+		&& saved->tlb_size == config->tlb_size && saved->tlb_ways == config->tlb_ways
+		&& saved->tlb_policy == config->tlb_policy && saved->address_spaces == config->address_spaces
+		&& saved->pt_levels == config->pt_levels && saved->superpage_bits == config->superpage_bits
+		&& saved->zero_copy == config->zero_copy && saved->l2_size == config->l2_size
+		&& (!config->l2_size || (saved->l2_ways == config->l2_ways && saved->l2_exclusive == config->l2_exclusive))
+		// OPT's order comes from the positions of future references, which other policies do not keep
+		&& saved->policy >= 0 && saved->policy < REPLACE_POLICIES
+		&& (config->policy != REPLACE_OPT || saved->policy == REPLACE_OPT);
+}
+
+int checkpoint_load(struct vm *vm, const char *path, uint64_t *state, int n)
+{
+	const struct vm_config *c = &vm->config;
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) return -1;
+	struct stream s = {fp, 0};
+	int result = -2;
+
+	char magic[8];
+	struct vm_config saved;
+	int saved_n = -1;
+	get(&s, magic, 8);
+	get(&s, &saved, sizeof(saved));
+	get(&s, &saved_n, sizeof(saved_n));
+	if (s.short_read || memcmp(magic, CHECKPOINT_MAGIC, 8) != 0 || !compatible(&saved, c) || saved_n != n) goto out;
+	get(&s, state, n * sizeof(uint64_t));
+
+	get(&s, &vm->stats, sizeof(vm->stats));
+	get(&s, &vm->asid, sizeof(vm->asid));
+	get(&s, &vm->free_page, sizeof(vm->free_page));
+	get(&s, &vm->flag, sizeof(vm->flag));
+	if (vm->asid < 0 || vm->asid >= c->address_spaces || vm->free_page < 0 || vm->free_page > c->frames) goto out;
+	vm->pagetable = &vm->space[vm->asid].pt;
+	for (int i = 0; i < c->address_spaces; i++) {
+		struct vm_space *space = &vm->space[i];
+		get(&s, &space->stats, sizeof(space->stats));
+		get(&s, &space->last_fault, sizeof(space->last_fault));
+		get(&s, &space->fault_stride, sizeof(space->fault_stride));
+		if (c->superpage_bits) {
+			size_t regions = vm->virtual_pages >> c->superpage_bits;
+			get(&s, space->resident, regions * sizeof(uint16_t));
+			get(&s, space->superpage, regions * sizeof(uint8_t));
+		}
+		if (get_pagetable(&s, &space->pt, vm->virtual_pages) < 0) goto out;
+	}
+
+	get(&s, vm->frame_owner, c->frames * sizeof(int));
+	get(&s, vm->frame_asid, c->frames * sizeof(int));
+	get(&s, vm->dirty, c->frames * sizeof(uint8_t));
+	get(&s, vm->prefetched, c->frames * sizeof(uint8_t));
+	if (!c->zero_copy) get(&s, vm->main_memory, (size_t)c->frames * vm->page_size);
+	get(&s, &vm->wb_count, sizeof(vm->wb_count));
+	// a batch as full as the write batch allows would have been written already
+	if (vm->wb_count < 0 || vm->wb_count >= c->write_batch) goto out;
+	get(&s, vm->wb_pages, vm->wb_count * sizeof(int));
+	get(&s, vm->wb_data, (size_t)vm->wb_count * vm->page_size);
+
+	get_tlb(&s, &vm->tlb);
+	if (c->l2_size) get_tlb(&s, &vm->l2);
+	int used = vm->flag ? c->frames : vm->free_page;
+	if (saved.policy == c->policy) {
+		get_replacer(&s, &vm->replacer);
+	} else {
+		// read past the saved order, then track the resident frames from scratch
+		struct replacer old;
+		replacer_init(&old, saved.policy, c->frames);
+		get_replacer(&s, &old);
+		replacer_free(&old);
+		for (int frame = 0; frame < used; frame++) {
+			if (vm->frame_owner[frame] != -1) replacer_insert(&vm->replacer, frame);
+		}
+	}
+	// between translations exactly the frames without a page are out of replacement
+	for (int frame = 0; frame < c->frames; frame++) vm->replacer.taken[frame] = vm->frame_owner[frame] == -1;
+	int store = 0, write_back = 0;
+	size_t size = 0;
+	get(&s, &store, sizeof(store));
+	if (store) {
+		get(&s, &size, sizeof(size));
+		get(&s, &write_back, sizeof(write_back));
+		if (s.short_read || size != vm->store->size || write_back != vm->store->write_back) goto out;
+		if (write_back) {
+			// the shared mapping is read-only and sees the file
+			char buf[1 << 16];
+			for (size_t done = 0; done < size && !s.short_read;) {
+				size_t len = size - done < sizeof(buf) ? size - done : sizeof(buf);
+				get(&s, buf, len);
+				if (s.short_read) break;
+				if (pwrite(vm->store->fd, buf, len, done) != (ssize_t)len) {
+					result = -1;
+					goto out;
+				}
+				done += len;
+			}
+		} else {
+			uint32_t written = 0;
+			get(&s, &written, sizeof(written));
+			for (uint32_t i = 0; i < written && !s.short_read; i++) {
+				uint32_t page = 0;
+				get(&s, &page, sizeof(page));
+				if (s.short_read) break;
+				if (page >= size / vm->page_size) goto out;
+				get(&s, vm->store->data + (size_t)page * vm->page_size, vm->page_size);
+				vm->store_written[page] = 1;
+			}
+		}
+	}
+	if (s.short_read) goto out;
+
+	if (c->zero_copy) {
+		// as page_in points them
+		size = vm->store->size;
+		for (int frame = 0; frame < used; frame++) {
+			if (vm->frame_owner[frame] == -1) continue;
+			size_t start = (size_t)vm->frame_owner[frame] * vm->page_size;
+			if (start + vm->page_size <= size) vm->frame_data[frame] = vm->store->data + start;
+			else vm->frame_data[frame] = vm->edge + (start < size ? 0 : vm->page_size);
+		}
+	}
+	result = 0;
+out:
+	if (ferror(fp)) {
+		result = -1;
+		errno = EIO;
+	}
+	fclose(fp);
+	return result;
+}
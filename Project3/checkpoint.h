@@ -0,0 +1,34 @@
+/**
+ * checkpoint.h
+ *
+ * Saves the whole state of a simulator to a file and restores it, so a long trace can be
+ * resumed from the last checkpoint, and several runs can start from one warmed-up state.
+ * The file holds the structures as this build lays them out and is only read back by it.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+#define CHECKPOINT_MAGIC "VMCKPT1\n"
+
+/* Writes vm and n words of driver state (trace positions and the like) to path. Waits for page
+ * reads in flight first. With store set the backing store goes in too, for traces with writes,
+ * so that pages written back after the checkpoint read as they were when it is resumed: the pages
+ * written to the private copy, or the whole file when dirty pages are written back to it.
+ * The file is replaced only once the new checkpoint is complete. Returns 0, or -1 with errno set. */
+int checkpoint_save(struct vm *vm, const char *path, const uint64_t *state, int n, int store);
+
+/* Restores vm, just set up by vm_init, and the n driver words from path. The configuration must
+ * match the saved one except for the replacement policy, write batch, prefetch, latencies and
+ * io_depth; a different policy starts from the resident frames in frame order, with no history.
+ * A saved backing store is put back into the mapping, or into the file when it is written back;
+ * either way the store has to be written back (or not) as when the checkpoint was made.
+ * Returns 0, -1 with errno set if the file cannot be read, or -2 if it is not a checkpoint
+ * this configuration can resume. */
+int checkpoint_load(struct vm *vm, const char *path, uint64_t *state, int n);
+
+#endif
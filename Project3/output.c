@@ -0,0 +1,145 @@
+/**
+ * output.c
+ *
+ * Output is collected in one large buffer and written with write(2) instead of
+ * going through printf for every translated address.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+
+#include "output.h"
+#include "vm.h"
+
+int output_parse_mode(const char *name)
+{
+	if (strcmp(name, "text") == 0) return OUTPUT_TEXT;
+	if (strcmp(name, "stats") == 0) return OUTPUT_STATS;
+	if (strcmp(name, "binary") == 0) return OUTPUT_BINARY;
+	return -1;
+}
+
+void output_init(struct output *o, enum output_mode mode)
+{
+	o->mode = mode;
+	o->fd = STDOUT_FILENO;
+	o->len = 0;
+	o->buf = malloc(OUTPUT_BUFFER_SIZE);
+	if (o->buf == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	if (mode == OUTPUT_BINARY) {
+		memcpy(o->buf, OUTPUT_MAGIC, OUTPUT_MAGIC_LEN);
+		o->len = OUTPUT_MAGIC_LEN;
+	}
+}
+
+void output_flush(struct output *o)
+{
+	size_t done = 0;
+	while (done < o->len) {
+		ssize_t n = write(o->fd, o->buf + done, o->len - done);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("write");
+			exit(1);
+		}
+		done += n;
+	}
+	o->len = 0;
+}
+
+void output_stats(struct output *o, uint64_t total_addresses, uint64_t page_faults, uint64_t tlb_hits)
+{
+	output_flush(o);
+	// keep the record stream on stdout clean in binary mode
+	FILE *fp = o->mode == OUTPUT_BINARY ? stderr : stdout;
+	fprintf(fp, "Number of Translated Addresses = %llu\n", (unsigned long long)total_addresses);
+	fprintf(fp, "Page Faults = %llu\n", (unsigned long long)page_faults);
+	fprintf(fp, "Page Fault Rate = %.3f\n", page_faults / (1. * total_addresses));
+	fprintf(fp, "TLB Hits = %llu\n", (unsigned long long)tlb_hits);
+	fprintf(fp, "TLB Hit Rate = %.3f\n", tlb_hits / (1. * total_addresses));
+	fflush(fp);
+}
+
+void output_printf(struct output *o, const char *format, ...)
+{
+	output_flush(o);
+	FILE *fp = o->mode == OUTPUT_BINARY ? stderr : stdout;
+	va_list args;
+	va_start(args, format);
+	vfprintf(fp, format, args);
+	va_end(args);
+	fflush(fp);
+}
+
+void output_vm_stats(struct output *o, const struct vm *vm)
+{
+	const struct vm_stats *s = &vm->stats;
+	output_stats(o, s->total_addresses, s->page_faults, s->tlb_hits);
+	if (vm->config.l2_size) {
+		uint64_t l1_hits = s->tlb_hits - s->l2_hits, l1_misses = s->total_addresses - l1_hits;
+		output_printf(o, "L1 TLB Hits = %llu\n", (unsigned long long)l1_hits);
+		output_printf(o, "L2 TLB Hits = %llu\n", (unsigned long long)s->l2_hits);
+		output_printf(o, "L2 TLB Hit Rate = %.3f\n", l1_misses ? s->l2_hits / (1. * l1_misses) : 0.);
+	}
+	if (vm->config.latency.memory > 0) {
+		output_printf(o, "Effective Access Time = %.2f ns\n", vm_effective_access_time(vm));
+	}
+	if (s->writes || s->write_backs) {
+		output_printf(o, "Writes = %llu\n", (unsigned long long)s->writes);
+		output_printf(o, "Write-backs = %llu\n", (unsigned long long)s->write_backs);
+		output_printf(o, "Write-back I/Os = %llu\n", (unsigned long long)s->write_back_ios);
+	}
+	if (vm->config.pt_levels > 1) {
+		size_t bytes = 0;
+		for (int i = 0; i < vm->config.address_spaces; i++) bytes += vm->space[i].pt.bytes;
+		output_printf(o, "Page Walks = %llu\n", (unsigned long long)s->page_walks);
+		output_printf(o, "Memory References per Walk = %.3f\n", s->page_walks ? s->walk_refs / (1. * s->page_walks) : 0.);
+		output_printf(o, "Page Table Memory = %zu bytes\n", bytes);
+	}
+	if (vm->config.prefetch) {
+		output_printf(o, "Prefetched Pages = %llu\n", (unsigned long long)s->prefetches);
+		output_printf(o, "Useful Prefetches = %llu\n", (unsigned long long)s->prefetch_hits);
+		output_printf(o, "Wasted Prefetches = %llu\n", (unsigned long long)s->prefetch_wasted);
+	}
+	if (vm->config.io_depth) {
+		const struct pagein *io = &vm->io;
+		output_printf(o, "Page-in Reads = %llu\n", (unsigned long long)io->reads);
+		output_printf(o, "Mean Page-in Latency = %.1f us\n", io->reads ? io->latency_total / 1e3 / io->reads : 0.);
+		output_printf(o, "Longest Page-in Latency = %.1f us\n", io->latency_max / 1e3);
+		output_printf(o, "Most Page-ins in Flight = %d\n", io->max_outstanding);
+		output_printf(o, "Time Waiting for Page-ins = %.3f ms\n", io->wait_total / 1e6);
+		// read time that passed while the simulator went on instead of waiting
+		double hidden = io->latency_total > io->wait_total ? 1 - io->wait_total / (double)io->latency_total : 0;
+		output_printf(o, "Page-in Time Overlapped = %.1f%%\n", 100 * hidden);
+	}
+	if (vm->config.superpage_bits) {
+		output_printf(o, "Superpage Promotions = %llu\n", (unsigned long long)s->promotions);
+		output_printf(o, "Superpage Demotions = %llu\n", (unsigned long long)s->demotions);
+		output_printf(o, "Pages Moved for Promotion = %llu\n", (unsigned long long)s->superpage_moves);
+		output_printf(o, "Superpage TLB Hits = %llu\n", (unsigned long long)s->superpage_hits);
+		output_printf(o, "TLB Reach = %llu bytes\n", (unsigned long long)vm_tlb_reach(vm));
+	}
+}
+
+void output_tlb_comparison(struct output *o, const struct vm *vm, const struct vm *base)
+{
+	double total = vm->stats.total_addresses ? vm->stats.total_addresses : 1;
+	double rate = vm->stats.tlb_hits / total, base_rate = base->stats.tlb_hits / total;
+	output_printf(o, "Base Page TLB Hit Rate = %.3f\n", base_rate);
+	output_printf(o, "Base Page TLB Reach = %llu bytes\n", (unsigned long long)vm_tlb_reach(base));
+	output_printf(o, "TLB Hit Rate Improvement = %+.3f\n", rate - base_rate);
+}
+
+void output_close(struct output *o)
+{
+	output_flush(o);
+	free(o->buf);
+	o->buf = NULL;
+}
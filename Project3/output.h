@@ -0,0 +1,138 @@
+/**
+ * output.h
+ *
+ * Buffered output of translated addresses and final statistics.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum output_mode {
+	OUTPUT_TEXT,	// "Virtual address: ... Value: ..." line per address, then stats
+	OUTPUT_STATS,	// stats only
+	OUTPUT_BINARY	// header followed by one struct output_record per address, stats on stderr
+};
+
+// First 8 bytes of a binary record stream.
+#define OUTPUT_MAGIC "VMOUT01\n"
+#define OUTPUT_MAGIC_LEN 8
+
+// output_record.flags
+#define OUTPUT_TLB_HIT 1
+#define OUTPUT_PAGE_FAULT 2
+
+// Binary record, written little-endian with no padding between fields (12 bytes).
+struct output_record {
+	uint32_t virtual_address;
+	uint32_t physical_address;
+	int8_t value;
+	uint8_t flags;
+	// address space (process) the address belongs to
+	uint16_t asid;
+};
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+// Longest text line is well below this.
+#define OUTPUT_MAX_LINE 128
+
+struct output {
+	enum output_mode mode;
+	int fd;
+	char *buf;
+	size_t len;
+};
+
+/* Returns the mode named by name ("text", "stats" or "binary") or -1. */
+int output_parse_mode(const char *name);
+
+/* Starts output in the given mode on stdout. Writes the header in binary mode. */
+void output_init(struct output *o, enum output_mode mode);
+
+/* Writes buffered output. */
+void output_flush(struct output *o);
+
+/* Writes the final statistics block and flushes. */
+void output_stats(struct output *o, uint64_t total_addresses, uint64_t page_faults, uint64_t tlb_hits);
+
+struct vm;
+
+/* Writes the statistics of a simulator: the final block plus the counters of the features in use. */
+void output_vm_stats(struct output *o, const struct vm *vm);
+
+/* Compares the TLB hit rate of vm with base, the same run with base pages only. */
+void output_tlb_comparison(struct output *o, const struct vm *vm, const struct vm *base);
+
+/* Writes an extra statistics line, to the same stream as output_stats. */
+void output_printf(struct output *o, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/* Flushes and frees the buffer. */
+void output_close(struct output *o);
+
+/* Writes the decimal digits of v at p and returns the position after them. */
+static inline char *output_uint(char *p, uint32_t v)
+{
+	static const char digits[] =
+		"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+	char tmp[10];
+	char *q = tmp + sizeof(tmp);
+	while (v >= 100) {
+		q -= 2;
+		memcpy(q, digits + (v % 100) * 2, 2);
+		v /= 100;
+	}
+	if (v >= 10) {
+		q -= 2;
+		memcpy(q, digits + v * 2, 2);
+	} else {
+		*--q = '0' + v;
+	}
+	size_t n = tmp + sizeof(tmp) - q;
+	memcpy(p, q, n);
+	return p + n;
+}
+
+static inline char *output_int(char *p, int v)
+{
+	if (v < 0) {
+		*p++ = '-';
+		return output_uint(p, -(uint32_t)v);
+	}
+	return output_uint(p, v);
+}
+
+/* Records one translated address. */
+static inline void output_translation(struct output *o, uint32_t virtual_address, uint32_t physical_address,
+	int value, unsigned flags, int asid)
+{
+	if (o->mode == OUTPUT_STATS) return;
+	if (o->len + OUTPUT_MAX_LINE > OUTPUT_BUFFER_SIZE) output_flush(o);
+
+	char *p = o->buf + o->len;
+	if (o->mode == OUTPUT_TEXT) {
+		memcpy(p, "Virtual address: ", 17);
+		p = output_uint(p + 17, virtual_address);
+		memcpy(p, " Physical address: ", 19);
+		p = output_uint(p + 19, physical_address);
+		memcpy(p, " Value: ", 8);
+		p = output_int(p + 8, value);
+		*p++ = '\n';
+	} else {
+		struct output_record r = {virtual_address, physical_address, value, flags, asid};
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		r.virtual_address = __builtin_bswap32(r.virtual_address);
+		r.physical_address = __builtin_bswap32(r.physical_address);
+		r.asid = __builtin_bswap16(r.asid);
+#endif
+		memcpy(p, &r, sizeof(r));
+		p += sizeof(r);
+	}
+	o->len = p - o->buf;
+}
+
+#endif
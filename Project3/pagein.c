@@ -0,0 +1,154 @@
+/**
+ * pagein.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pagein.h"
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *reader(void *arg)
+{
+	struct pagein *io = arg;
+	pthread_mutex_lock(&io->lock);
+	for (;;) {
+		while (io->queue_len == 0 && !io->stop) pthread_cond_wait(&io->work, &io->lock);
+		// queued reads are finished before stopping, they write into the caller's frames
+		if (io->queue_len == 0) break;
+		struct pagein_request *r = &io->requests[io->queue[io->queue_head]];
+		io->queue_head = (io->queue_head + 1) % io->depth;
+		io->queue_len--;
+		pthread_mutex_unlock(&io->lock);
+
+		size_t done = 0;
+		int error = 0;
+		while (done < r->len) {
+			ssize_t n = pread(io->fd, (char *)r->buf + done, r->len - done, r->offset + done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n < 0) error = errno;
+			if (n <= 0) break;
+			done += n;
+		}
+		uint64_t end = now_ns();
+
+		pthread_mutex_lock(&io->lock);
+		r->result = error ? -1 : (ssize_t)done;
+		r->error = error;
+		r->latency = end - r->submitted;
+		r->state = PAGEIN_DONE;
+		pthread_cond_broadcast(&io->done);
+	}
+	pthread_mutex_unlock(&io->lock);
+	return NULL;
+}
+
+int pagein_init(struct pagein *io, int fd, int depth)
+{
+	memset(io, 0, sizeof(*io));
+	if (fd < 0 || depth < 1) return -1;
+	io->fd = fd;
+	io->depth = depth;
+	io->requests = calloc(depth, sizeof(struct pagein_request));
+	io->queue = calloc(depth, sizeof(int));
+	io->threads = calloc(depth, sizeof(pthread_t));
+	if (!io->requests || !io->queue || !io->threads) {
+		perror("calloc");
+		exit(1);
+	}
+	pthread_mutex_init(&io->lock, NULL);
+	pthread_cond_init(&io->work, NULL);
+	pthread_cond_init(&io->done, NULL);
+	// one thread per slot, so every outstanding read can be in pread at once
+	for (int i = 0; i < depth; i++) {
+		if (pthread_create(&io->threads[i], NULL, reader, io) != 0) {
+			fprintf(stderr, "Cannot start page-in threads\n");
+			exit(1);
+		}
+	}
+	return 0;
+}
+
+void pagein_free(struct pagein *io)
+{
+	if (io->threads == NULL) return;
+	pthread_mutex_lock(&io->lock);
+	io->stop = 1;
+	pthread_cond_broadcast(&io->work);
+	pthread_mutex_unlock(&io->lock);
+	for (int i = 0; i < io->depth; i++) pthread_join(io->threads[i], NULL);
+	pthread_mutex_destroy(&io->lock);
+	pthread_cond_destroy(&io->work);
+	pthread_cond_destroy(&io->done);
+	free(io->requests);
+	free(io->queue);
+	free(io->threads);
+	memset(io, 0, sizeof(*io));
+}
+
+int pagein_submit(struct pagein *io, void *buf, size_t len, off_t offset)
+{
+	pthread_mutex_lock(&io->lock);
+	int slot = -1;
+	for (int i = 0; i < io->depth && slot == -1; i++) {
+		if (io->requests[i].state == PAGEIN_FREE) slot = i;
+	}
+	if (slot == -1) {
+		pthread_mutex_unlock(&io->lock);
+		return -1;
+	}
+	struct pagein_request *r = &io->requests[slot];
+	r->buf = buf;
+	r->len = len;
+	r->offset = offset;
+	r->seq = io->next_seq++;
+	r->submitted = now_ns();
+	r->state = PAGEIN_QUEUED;
+	io->queue[(io->queue_head + io->queue_len) % io->depth] = slot;
+	io->queue_len++;
+	if (++io->outstanding > io->max_outstanding) io->max_outstanding = io->outstanding;
+	pthread_cond_signal(&io->work);
+	pthread_mutex_unlock(&io->lock);
+	return slot;
+}
+
+ssize_t pagein_wait(struct pagein *io, int slot)
+{
+	struct pagein_request *r = &io->requests[slot];
+	uint64_t start = now_ns();
+	pthread_mutex_lock(&io->lock);
+	while (r->state != PAGEIN_DONE) pthread_cond_wait(&io->done, &io->lock);
+	r->state = PAGEIN_FREE;
+	io->outstanding--;
+	io->reads++;
+	io->latency_total += r->latency;
+	if (r->latency > io->latency_max) io->latency_max = r->latency;
+	pthread_mutex_unlock(&io->lock);
+	io->wait_total += now_ns() - start;
+	if (r->result < 0) {
+		fprintf(stderr, "pread: %s\n", strerror(r->error));
+		exit(1);
+	}
+	return r->result;
+}
+
+int pagein_oldest(struct pagein *io)
+{
+	int oldest = -1;
+	pthread_mutex_lock(&io->lock);
+	for (int i = 0; i < io->depth; i++) {
+		if (io->requests[i].state != PAGEIN_FREE && (oldest == -1 || io->requests[i].seq < io->requests[oldest].seq)) oldest = i;
+	}
+	pthread_mutex_unlock(&io->lock);
+	return oldest;
+}
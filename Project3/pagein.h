@@ -0,0 +1,76 @@
+/**
+ * pagein.h
+ *
+ * Asynchronous page reads from the backing store file. A pool of threads serves up to depth
+ * outstanding pread requests, so the caller can go on translating while pages are read,
+ * and the time from submitting a read to its completion is measured.
+ */
+
+#ifndef PAGEIN_H
+#define PAGEIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+enum pagein_state {
+	PAGEIN_FREE,
+	PAGEIN_QUEUED,	// waiting for or being read by a thread
+	PAGEIN_DONE
+};
+
+struct pagein_request {
+	enum pagein_state state;
+	void *buf;
+	size_t len;
+	off_t offset;
+	// bytes read (short at the end of the file), or -1 with the errno in error
+	ssize_t result;
+	int error;
+	// submission order, and nanoseconds from submission to completion
+	uint64_t seq;
+	uint64_t submitted;
+	uint64_t latency;
+};
+
+struct pagein {
+	int fd;
+	int depth;
+	// depth request slots and a ring of the queued ones the threads have not picked up
+	struct pagein_request *requests;
+	int *queue;
+	int queue_head;
+	int queue_len;
+	int outstanding;
+	uint64_t next_seq;
+	int stop;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	// work: a request was queued or stop set; done: a read completed
+	pthread_cond_t work;
+	pthread_cond_t done;
+	// completed reads, their total and longest latency, time spent in pagein_wait and most reads in flight at once
+	uint64_t reads;
+	uint64_t latency_total;
+	uint64_t latency_max;
+	uint64_t wait_total;
+	int max_outstanding;
+};
+
+/* Starts depth threads reading from fd. Returns 0 on success, -1 on error. */
+int pagein_init(struct pagein *io, int fd, int depth);
+
+/* Waits for the reads in flight and stops the threads. */
+void pagein_free(struct pagein *io);
+
+/* Queues a read of len bytes at offset into buf. Returns its slot, or -1 if depth reads are outstanding. */
+int pagein_submit(struct pagein *io, void *buf, size_t len, off_t offset);
+
+/* Waits for the read in slot and frees the slot. Returns the bytes read; exits on a read error. */
+ssize_t pagein_wait(struct pagein *io, int slot);
+
+/* Returns the slot of the outstanding read submitted first, or -1 if there is none. */
+int pagein_oldest(struct pagein *io);
+
+#endif
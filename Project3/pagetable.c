@@ -0,0 +1,112 @@
+/**
+ * pagetable.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pagetable.h"
+
+/* Bump allocates a node from the pool. Nodes live until pt_free. */
+static void *pt_alloc(struct pagetable *pt, size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	struct pt_chunk *c = pt->chunks;
+	if (c == NULL || c->size - c->used < size) {
+		size_t chunk = size > PT_POOL_CHUNK ? size : PT_POOL_CHUNK;
+		c = malloc(sizeof(struct pt_chunk) + chunk);
+		if (c == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		c->next = pt->chunks;
+		c->used = 0;
+		c->size = chunk;
+		pt->chunks = c;
+	}
+	void *node = (char *)(c + 1) + c->used;
+	c->used += size;
+	pt->bytes += size;
+	return node;
+}
+
+static void *pt_new_interior(struct pagetable *pt, int level)
+{
+	size_t size = sizeof(void *) << pt->bits[level];
+	void *node = pt_alloc(pt, size);
+	memset(node, 0, size);
+	return node;
+}
+
+static void *pt_new_leaf(struct pagetable *pt)
+{
+	size_t size = sizeof(int) << pt->bits[pt->levels - 1];
+	void *node = pt_alloc(pt, size);
+	// -1 for unmapped pages
+	memset(node, 0xff, size);
+	return node;
+}
+
+int pt_init(struct pagetable *pt, int page_bits, int levels)
+{
+	memset(pt, 0, sizeof(*pt));
+	if (levels < 1 || levels > PT_MAX_LEVELS || page_bits < levels || page_bits > 32) return -1;
+	pt->levels = levels;
+	// split the page number evenly, the top level takes what is left over
+	int shift = 0;
+	for (int level = levels - 1; level >= 0; level--) {
+		pt->bits[level] = page_bits / levels + (level == 0 ? page_bits % levels : 0);
+		pt->shift[level] = shift;
+		shift += pt->bits[level];
+	}
+	pt->root = levels == 1 ? pt_new_leaf(pt) : pt_new_interior(pt, 0);
+	return 0;
+}
+
+void pt_free(struct pagetable *pt)
+{
+	struct pt_chunk *c = pt->chunks;
+	while (c) {
+		struct pt_chunk *next = c->next;
+		free(c);
+		c = next;
+	}
+	memset(pt, 0, sizeof(*pt));
+}
+
+int *pt_leaf(struct pagetable *pt, uint32_t page)
+{
+	void *node = pt->root;
+	int last = pt->levels - 1;
+	for (int level = 0; level < last; level++) {
+		void **slot = &((void **)node)[(page >> pt->shift[level]) & ((1u << pt->bits[level]) - 1)];
+		if (*slot == NULL) __atomic_store_n(slot, level + 1 == last ? pt_new_leaf(pt) : pt_new_interior(pt, level + 1), __ATOMIC_RELEASE);
+		node = *slot;
+	}
+	return node;
+}
+
+void pt_set(struct pagetable *pt, uint32_t page, int frame)
+{
+	int *leaf = pt_leaf(pt, page);
+	__atomic_store_n(&leaf[page & ((1u << pt->bits[pt->levels - 1]) - 1)], frame, __ATOMIC_RELEASE);
+}
+
+static void for_each_leaf(const struct pagetable *pt, void *node, int level, uint32_t first_page,
+	void (*fn)(void *arg, uint32_t first_page, const int *leaf), void *arg)
+{
+	if (level == pt->levels - 1) {
+		fn(arg, first_page, node);
+		return;
+	}
+	for (uint32_t i = 0; i < 1u << pt->bits[level]; i++) {
+		void *child = ((void **)node)[i];
+		if (child) for_each_leaf(pt, child, level + 1, first_page | i << pt->shift[level], fn, arg);
+	}
+}
+
+void pt_for_each_leaf(const struct pagetable *pt, void (*fn)(void *arg, uint32_t first_page, const int *leaf), void *arg)
+{
+	if (pt->root) for_each_leaf(pt, pt->root, 0, 0, fn, arg);
+}
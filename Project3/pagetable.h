@@ -0,0 +1,82 @@
+/**
+ * pagetable.h
+ *
+ * Radix page table of 1 to 4 levels for page numbers of up to 32 bits. Interior nodes and leaves
+ * are only allocated for the parts of the address space that get mapped, from a pool owned by the table.
+ */
+
+#ifndef PAGETABLE_H
+#define PAGETABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PT_MAX_LEVELS 4
+// Size of the blocks the node pool takes from malloc.
+#define PT_POOL_CHUNK (1 << 20)
+
+struct pt_chunk {
+	struct pt_chunk *next;
+	size_t used;
+	size_t size;
+	// node memory follows
+};
+
+struct pagetable {
+	int levels;
+	// index bits per level, top level first, and the shift that extracts each index
+	int bits[PT_MAX_LEVELS];
+	int shift[PT_MAX_LEVELS];
+	// top level node: an array of child pointers, or the leaf itself for a single level
+	void *root;
+	// node pool
+	struct pt_chunk *chunks;
+	size_t bytes;
+};
+
+/* Sets up an empty table for page numbers of page_bits bits. Returns 0 on success, -1 for bad arguments. */
+int pt_init(struct pagetable *pt, int page_bits, int levels);
+
+/* Frees every node. */
+void pt_free(struct pagetable *pt);
+
+/* Maps page to frame, allocating the nodes on its path. New nodes and the entry are published
+ * with release stores, so pt_lookup_shared on other threads sees them complete. */
+void pt_set(struct pagetable *pt, uint32_t page, int frame);
+
+/* Returns the leaf holding the entry of page, allocating the nodes on its path. */
+int *pt_leaf(struct pagetable *pt, uint32_t page);
+
+/* Calls fn with the first page and the entries of every allocated leaf. */
+void pt_for_each_leaf(const struct pagetable *pt, void (*fn)(void *arg, uint32_t first_page, const int *leaf), void *arg);
+
+/* Returns the frame of page or -1 if it is not mapped, and adds the number of
+ * table entries read during the walk to *refs. */
+static inline int pt_lookup(const struct pagetable *pt, uint32_t page, uint64_t *refs)
+{
+	void *node = pt->root;
+	int last = pt->levels - 1;
+	for (int level = 0; level < last; level++) {
+		(*refs)++;
+		node = ((void **)node)[(page >> pt->shift[level]) & ((1u << pt->bits[level]) - 1)];
+		if (node == NULL) return -1;
+	}
+	(*refs)++;
+	return ((int *)node)[page & ((1u << pt->bits[last]) - 1)];
+}
+
+/* pt_lookup for tables that another thread changes with pt_set while this one reads, without a lock. */
+static inline int pt_lookup_shared(const struct pagetable *pt, uint32_t page, uint64_t *refs)
+{
+	void *node = pt->root;
+	int last = pt->levels - 1;
+	for (int level = 0; level < last; level++) {
+		(*refs)++;
+		node = __atomic_load_n(&((void **)node)[(page >> pt->shift[level]) & ((1u << pt->bits[level]) - 1)], __ATOMIC_ACQUIRE);
+		if (node == NULL) return -1;
+	}
+	(*refs)++;
+	return __atomic_load_n(&((int *)node)[page & ((1u << pt->bits[last]) - 1)], __ATOMIC_ACQUIRE);
+}
+
+#endif
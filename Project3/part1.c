@@ -1,137 +1,204 @@
 /**
- * virtmem.c 
+ * virtmem.c
  */
 
 #include <stdio.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "trace.h"
+#include "output.h"
+#include "vm.h"
+#include "window.h"
+#include "stream.h"
+#include "checkpoint.h"
 
 #define TLB_SIZE 16
-#define PAGES 1024
-#define PAGE_MASK 0xffc00
-
-#define PAGE_SIZE 1024
-#define OFFSET_BITS 10
-#define OFFSET_MASK 0x003ff
-
-#define MEMORY_SIZE PAGES * PAGE_SIZE
-
-// Max number of characters per line of input file to read.
-#define BUFFER_SIZE 10
-
-struct tlbentry {
-	unsigned char logical;
-	unsigned char physical;
-};
-
-// TLB is kept track of as a circular array, with the oldest element being overwritten once the TLB is full.
-struct tlbentry tlb[TLB_SIZE];
-// number of inserts into TLB that have been completed. Use as tlbindex % TLB_SIZE for the index of the next TLB line to use.
-int tlbindex = 0;
-
-// pagetable[logical_page] is the physical page number for logical page. Value is -1 if that logical page isn't yet in the table.
-int pagetable[PAGES];
-
-signed char main_memory[MEMORY_SIZE];
-
-// Pointer to memory mapped backing file
-signed char *backing;
-
-int max(int a, int b)
+#define TLB_WAYS 0
+// 20 bit logical and physical addresses, so there are as many frames as pages and nothing is ever replaced
+#define ADDRESS_BITS 20
+// part1 never writes, so frames can be views of the backing store
+#define ZERO_COPY 1
+#define PT_LEVELS 1
+// addresses between checkpoints
+#define CHECKPOINT_INTERVAL 1000000
+
+void usage()
 {
-	if (a > b) return a;
-  	return b;
+	fprintf(stderr, "Usage ./virtmem backingstore input [-o text|stats|binary] [-t tlb_size] [-a tlb_ways (0 for fully associative)] [-r fifo|lru|plru|random] [-T l2_tlb_size] [-A l2_tlb_ways] [-I inclusive|exclusive] [-l tlb,l2,memory,fault (latencies in ns)] [-s page_size] [-v virtual_bits] [-P physical_bits] [-L page_table_levels (1-4)] [-k prefetch_pages] [-H pages_per_superpage] [-z 0|1 (frames point into backingstore instead of copies)] [-Q page_in_queue_depth (0 copies from the mapped store)] [-x windows.csv|windows.json] [-W window_length] [-S 0|1 (stream the input, always for - as stdin)] [-C checkpoint_file] [-c checkpoint_interval] [-R checkpoint_to_resume]\n");
+	exit(1);
 }
 
-/* Returns the physical address from TLB or -1 if not present. */
-int search_tlb(unsigned char logical_page) {
-    for(int i = 0; i < TLB_SIZE; i++){
-    	if(tlb[i].logical == logical_page) return tlb[i].physical;
-    }
-    return -1;
+/* Translates n addresses, printing each one and recording it in window unless that is NULL. */
+void translate(struct vm *vm, const uint32_t *addrs, size_t n, struct output *out, struct window *window)
+{
+	for (size_t k = 0; k < n; k++) {
+		uint32_t logical_address = addrs[k];
+		unsigned flags = 0;
+		uint32_t physical_address = vm_translate(vm, logical_address, &flags);
+		signed char value = vm_load(vm, physical_address);
+		output_translation(out, logical_address, physical_address, value, flags, 0);
+		if (window) window_record(window, 0, logical_address, flags);
+	}
 }
 
-/* Adds the specified mapping to the TLB, replacing the oldest mapping (FIFO replacement). */
-void add_to_tlb(unsigned char logical, unsigned char physical) {
-	struct tlbentry new_entry = {logical, physical};
-    tlb[tlbindex++ % TLB_SIZE] = new_entry;
-    //add and move
+struct checkpointing {
+	// NULL when no checkpoints are written
+	const char *path;
+	uint64_t interval;
+	// addresses of the trace translated so far, and the position of the next checkpoint
+	uint64_t position;
+	uint64_t next;
+};
+
+/* translate, writing a checkpoint whenever the position in the trace reaches the next one. */
+void translate_checkpointed(struct vm *vm, const uint32_t *addrs, size_t n, struct output *out, struct window *window, struct checkpointing *cp)
+{
+	while (n) {
+		size_t step = n;
+		if (cp->path && cp->next - cp->position < step) step = cp->next - cp->position;
+		translate(vm, addrs, step, out, window);
+		addrs += step;
+		n -= step;
+		cp->position += step;
+		if (cp->path && cp->position == cp->next) {
+			if (checkpoint_save(vm, cp->path, &cp->position, 1, 0) < 0) fprintf(stderr, "Cannot write checkpoint %s: %s\n", cp->path, strerror(errno));
+			cp->next += cp->interval;
+		}
+	}
 }
 
 int main(int argc, const char *argv[])
 {
-	if (argc != 3) {
-	fprintf(stderr, "Usage ./virtmem backingstore input\n");
-	exit(1);
+	if (argc < 3 || argc % 2 == 0) usage();
+	int output_mode = OUTPUT_TEXT;
+	const char *window_filename = NULL;
+	long window_length = WINDOW_LENGTH;
+	int streaming = 0;
+	struct checkpointing cp = {NULL, CHECKPOINT_INTERVAL, 0, 0};
+	const char *resume_filename = NULL;
+	struct vm_config config = {OFFSET_BITS, ADDRESS_BITS, ADDRESS_BITS, 0, REPLACE_FIFO, TLB_SIZE, TLB_WAYS, TLB_FIFO, 1, 1, PT_LEVELS, 0, 0, ZERO_COPY};
+	for (int i = 3; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-o") == 0) output_mode = output_parse_mode(argv[i+1]);
+		else if (strcmp(argv[i], "-t") == 0) config.tlb_size = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-a") == 0) config.tlb_ways = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-r") == 0) config.tlb_policy = tlb_parse_policy(argv[i+1]);
+		else if (strcmp(argv[i], "-T") == 0) config.l2_size = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-A") == 0) config.l2_ways = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-I") == 0 && strcmp(argv[i+1], "inclusive") == 0) config.l2_exclusive = 0;
+		else if (strcmp(argv[i], "-I") == 0 && strcmp(argv[i+1], "exclusive") == 0) config.l2_exclusive = 1;
+		else if (strcmp(argv[i], "-l") == 0) {
+			if (vm_parse_latency(argv[i+1], &config.latency) < 0) usage();
+		}
+		else if (strcmp(argv[i], "-s") == 0) config.offset_bits = vm_parse_page_size(argv[i+1]);
+		else if (strcmp(argv[i], "-v") == 0) config.virtual_bits = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-P") == 0) config.physical_bits = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-L") == 0) config.pt_levels = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-k") == 0) config.prefetch = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-x") == 0) window_filename = argv[i+1];
+		else if (strcmp(argv[i], "-W") == 0) window_length = atol(argv[i+1]);
+		else if (strcmp(argv[i], "-S") == 0) streaming = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-z") == 0) config.zero_copy = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-Q") == 0) config.io_depth = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-H") == 0) config.superpage_bits = vm_parse_superpage(argv[i+1]);
+		else if (strcmp(argv[i], "-C") == 0) cp.path = argv[i+1];
+		else if (strcmp(argv[i], "-c") == 0) cp.interval = strtoull(argv[i+1], NULL, 10);
+		else if (strcmp(argv[i], "-R") == 0) resume_filename = argv[i+1];
+		else usage();
+	}
+	// an L2 TLB is there to compare latencies, so it turns the latency model on
+	if (config.l2_size && config.latency.memory == 0) vm_parse_latency("", &config.latency);
+	if (output_mode < 0 || (int)config.tlb_policy < 0 || config.offset_bits < 0 || config.superpage_bits < 0) usage();
+	// windows are numbered from the start of the trace
+	if (cp.interval == 0 || (resume_filename && window_filename)) usage();
+	// reads fill the frames, so there have to be copies
+	if (config.io_depth) config.zero_copy = 0;
+	// all of physical memory is available; vm_init rejects more frames than an int holds
+	if (config.physical_bits > config.offset_bits && config.physical_bits <= 32) {
+		unsigned frames = 1u << (config.physical_bits - config.offset_bits);
+		config.frames = frames <= INT_MAX ? (int)frames : 0;
 	}
 
-	const char *backing_filename = argv[1]; 
-	int backing_fd = open(backing_filename, O_RDONLY);
-	backing = mmap(0, MEMORY_SIZE, PROT_READ, MAP_PRIVATE, backing_fd, 0); 
+	const char *backing_filename = argv[1];
+	struct backing_store backing;
+	if (backing_open(&backing, backing_filename, 0) < 0) exit(1);
 
 	const char *input_filename = argv[2];
-	FILE *input_fp = fopen(input_filename, "r");
-
-	// Fill page table entries with -1 for initially empty table.
-	int i;
-	for (i = 0; i < PAGES; i++) {
-		pagetable[i] = -1;
+	if (strcmp(input_filename, "-") == 0) streaming = 1;
+	struct trace trace;
+	struct trace_stream stream;
+	if ((streaming ? trace_stream_open(&stream, input_filename) : trace_open(&trace, input_filename)) < 0) exit(1);
+
+	struct vm vm;
+	if (vm_init(&vm, &config, &backing) < 0) {
+		fprintf(stderr, "Invalid configuration: address widths must be at most 32 and larger than the page offset, 1 to 4 page table levels, TLB size / ways a power of two (and ways too for plru)\n");
+		exit(1);
 	}
 
-	// Character buffer for reading lines of input file.
-	char buffer[BUFFER_SIZE];
-
-	// Data we need to keep track of to compute stats at end.
-	int total_addresses = 0;
-	int tlb_hits = 0;
-	int page_faults = 0;
-	// Number of the next unallocated physical page in main memory
-	unsigned char free_page = 0;
-
-	while (fgets(buffer, BUFFER_SIZE, input_fp) != NULL) {
-		total_addresses++;
-		int logical_address = atoi(buffer);
-
-		/* Calculate the page offset and logical page number from logical_address */
-		int offset = logical_address & OFFSET_MASK;
-		int logical_page = (logical_address & PAGE_MASK) >> OFFSET_BITS;
-		int physical_page = search_tlb(logical_page);
-
-		// TLB hit
-		if (physical_page != -1) {
-	  		tlb_hits++;
-	  		// TLB miss
-		} else {
-	  		physical_page = pagetable[logical_page];
-	 		// Page fault
-	 		if (physical_page == -1) {
-		 		page_faults++;
-		 		
-		 		//copy page from backing file to main_memory      	
-	  	 		memcpy(main_memory + free_page*PAGE_SIZE, backing + logical_page * PAGE_SIZE, PAGE_SIZE);
-	  	 		//physical_page is current free_page.
-	  			physical_page = free_page++;
-				pagetable[logical_page] = physical_page;
-	  		}
-			add_to_tlb(logical_page, physical_page);
+	if (resume_filename) {
+		int result = checkpoint_load(&vm, resume_filename, &cp.position, 1);
+		if (result == -1) fprintf(stderr, "Cannot read checkpoint %s: %s\n", resume_filename, strerror(errno));
+		if (result == -2) fprintf(stderr, "%s is not a checkpoint of this configuration\n", resume_filename);
+		if (result < 0) exit(1);
+		if (!streaming && cp.position > trace.count) {
+			fprintf(stderr, "%s is past the end of the input\n", resume_filename);
+			exit(1);
 		}
-
-		int physical_address = (physical_page << OFFSET_BITS) | offset;
-		signed char value = main_memory[physical_address];
-		printf("Virtual address: %d Physical address: %d Value: %d\n", logical_address, physical_address, value);
-
+	}
+	cp.next = cp.position + cp.interval;
+	uint64_t resume_position = cp.position;
+
+	struct window window;
+	if (window_filename && (window_length <= 0 || window_open(&window, window_filename, window_length, &vm) < 0)) usage();
+
+	// the same trace with base pages only, for comparison
+	struct vm base;
+	struct vm_config base_config = config;
+	base_config.superpage_bits = 0;
+	// the base run is not in the checkpoint, so a resumed run has nothing to compare with
+	int compare = config.superpage_bits && !resume_filename;
+	if (compare && vm_init(&base, &base_config, &backing) < 0) {
+		fprintf(stderr, "Invalid configuration for the base page comparison\n");
+		exit(1);
 	}
 
+	struct output out;
+	output_init(&out, output_mode);
+
+	struct window *w = window_filename ? &window : NULL;
+	if (streaming) {
+		const struct trace_chunk *chunk;
+		// addresses read from the stream, the first resume_position of which were translated before the checkpoint
+		uint64_t seen = 0;
+		while ((chunk = trace_stream_next(&stream)) != NULL) {
+			size_t skip = 0;
+			if (seen < resume_position) skip = resume_position - seen < chunk->count ? resume_position - seen : chunk->count;
+			seen += chunk->count;
+			translate_checkpointed(&vm, chunk->addrs + skip, chunk->count - skip, &out, w, &cp);
+			if (compare) vm_run(&base, chunk->addrs, chunk->count);
+		}
+		if (stream.error) exit(1);
+		if (seen < resume_position) {
+			fprintf(stderr, "%s is past the end of the input\n", resume_filename);
+			exit(1);
+		}
+	} else {
+		translate_checkpointed(&vm, trace.addrs + cp.position, trace.count - cp.position, &out, w, &cp);
+		if (compare) vm_run(&base, trace.addrs, trace.count);
+	}
+	if (window_filename) window_close(&window);
 
-	printf("Number of Translated Addresses = %d\n", total_addresses);
-	printf("Page Faults = %d\n", page_faults);
-	printf("Page Fault Rate = %.3f\n", page_faults / (1. * total_addresses));
-	printf("TLB Hits = %d\n", tlb_hits);
-	printf("TLB Hit Rate = %.3f\n", tlb_hits / (1. * total_addresses));
+	output_vm_stats(&out, &vm);
+	if (compare) {
+		output_tlb_comparison(&out, &vm, &base);
+		vm_free(&base);
+	}
+	output_close(&out);
 
+	vm_free(&vm);
+	if (streaming) trace_stream_close(&stream);
+	else trace_close(&trace);
+	backing_close(&backing);
 	return 0;
 }
@@ -1,191 +1,439 @@
 /**
- * virtmem.c 
+ * virtmem.c
  */
 
 #include <stdio.h>
-#include <sys/mman.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include "trace.h"
+#include "output.h"
+#include "vm.h"
+#include "window.h"
+#include "stream.h"
+#include "stackdist.h"
+#include "sweep.h"
+#include "smp.h"
+#include "checkpoint.h"
+
 #define TLB_SIZE 16
-#define VIRTUAL_PAGES 1024
+#define TLB_WAYS 0
+// 32 bit virtual addresses, 4M pages of 1 KiB
+#define VIRTUAL_BITS 32
+#define PHYSICAL_BITS 32
 #define PHYSICAL_PAGES 256
-#define PAGE_MASK 0xffc00
-
-#define PAGE_SIZE 1024
-#define OFFSET_BITS 10
-#define OFFSET_MASK 0x003ff
-
-#define MEMORY_SIZE PHYSICAL_PAGES * PAGE_SIZE
-
-// Max number of characters per line of input file to read.
-#define BUFFER_SIZE 10
-
-int flag = 0;
-struct tlbentry {
-	int logical;
-	int physical;
-};
-
-// TLB is kept track of as a circular array, with the oldest element being overwritten once the TLB is full.
-struct tlbentry tlb[TLB_SIZE];
-// number of inserts into TLB that have been completed. Use as tlbindex % TLB_SIZE for the index of the next TLB line to use.
-int tlbindex = 0;
-
-// pagetable[logical_page] is the physical page number for logical page. Value is -1 if that logical page isn't yet in the table.
-int pagetable[VIRTUAL_PAGES];
+// two level page table, so memory grows with the pages touched rather than the address space
+#define ZERO_COPY 0
+#define PT_LEVELS 2
+// Addresses a process translates before the scheduler switches to the next one.
+#define QUANTUM 100
+// Addresses between checkpoints, taken at the next switch.
+#define CHECKPOINT_INTERVAL 1000000
 
-//keep total_address number (like current time) when a page is referenced
-int counter_pagetable[PHYSICAL_PAGES];
+// Most values one comma separated option can list in sweep mode, and most processes.
+#define MAX_LIST 64
 
-signed char main_memory[MEMORY_SIZE];
+enum run_mode { MODE_SIM, MODE_MRC, MODE_SWEEP, MODE_SMP };
 
-// Pointer to memory mapped backing file
-signed char *backing;
+void usage()
+{
+	fprintf(stderr, "Usage ./part2 backingstore input[,input2,...] -p * (0 FIFO, 1 LRU, 2 CLOCK, 3 second-chance, 4 LFU, 5 OPT) [-f frames] [-o text|stats|binary] [-t tlb_size] [-a tlb_ways (0 for fully associative)] [-r fifo|lru|plru|random] [-T l2_tlb_size] [-A l2_tlb_ways] [-I inclusive|exclusive] [-l tlb,l2,memory,fault (latencies in ns)] [-m sim|mrc|sweep|smp] [-j threads] [-q quantum] [-w 0|1 (write dirty pages to backingstore)] [-b write_batch] [-s page_size] [-v virtual_bits] [-P physical_bits] [-L page_table_levels (1-4)] [-k prefetch_pages] [-H pages_per_superpage] [-z 0|1 (frames point into backingstore instead of copies)] [-Q page_in_queue_depth (0 copies from the mapped store)] [-x windows.csv|windows.json] [-W window_length] [-S 0|1 (stream the input, always for - as stdin)] [-C checkpoint_file] [-c checkpoint_interval] [-R checkpoint_to_resume]\n");
+	fprintf(stderr, "In sweep mode -p, -f and -t take comma separated lists and every combination is simulated.\n");
+	fprintf(stderr, "In smp mode -j lists CPU counts; each run splits the trace between that many CPUs sharing the page table and frames (-p 0 or 2).\n");
+	fprintf(stderr, "In sim mode -C saves the simulation every checkpoint_interval addresses and -R goes on from a saved one, with any -p (OPT only from an OPT checkpoint). With -w 1 and writes each checkpoint holds the whole backingstore.\n");
+	fprintf(stderr, "Several comma separated inputs are run as processes with their own page tables, switching round-robin every quantum addresses.\n");
+	exit(1);
+}
 
-void fifo_page_replacement(unsigned char free_page){
-	//find corresponding entry and make -1
-	for (int i = 0; i < VIRTUAL_PAGES; i++) {
-		if(pagetable[i]==free_page){
-			pagetable[i]=-1;
-			break;
-		}
+/* Parses a comma separated list of integers into vals. Returns the count or -1. */
+int parse_list(const char *s, int *vals, int max)
+{
+	int n = 0;
+	while (*s) {
+		char *end;
+		long v = strtol(s, &end, 10);
+		if (end == s || n == max) return -1;
+		vals[n++] = v;
+		if (*end == ',') end++;
+		else if (*end != '\0') return -1;
+		s = end;
 	}
+	return n;
 }
 
-unsigned char lru_page_replacement(){
-	int min = counter_pagetable[0];
-	unsigned char min_index = 0;
-	//find least recent used
-	for (int i = 0; i < PHYSICAL_PAGES; i++) {
-		if(counter_pagetable[i]<min){
-			min_index=i;
-			min = counter_pagetable[i];
-		}
+/* Where the scheduler is in each trace, so a run can stop and go on later. */
+struct schedule {
+	size_t position[MAX_LIST];
+	// VM_PAGE_FAULT for a process that yielded on a fault, to go on the flags of that address
+	unsigned faulted[MAX_LIST];
+	// process to run next
+	int next;
+};
+
+/* Round-robin scheduler: each process runs for quantum addresses, finished processes are skipped.
+ * With page reads from the file (io_depth), a process that faults gives up the rest of its quantum
+ * while its page is read, so the reads of several processes are in flight together.
+ * Without out, only translates: writes are treated as reads and nothing is printed.
+ * Each translation is recorded in window unless it is NULL. Goes on from s, and stops at the first
+ * switch once vm has translated stop addresses. Returns 1 when every trace is done, 0 when stopped. */
+int run_processes(struct vm *vm, const struct trace *traces, int n_procs, int quantum, struct output *out, struct window *window,
+	struct schedule *s, uint64_t stop)
+{
+	int overlap = vm->config.io_depth && n_procs > 1;
+	int running = 0;
+	for (int asid = 0; asid < n_procs; asid++) {
+		if (s->position[asid] < traces[asid].count) running++;
 	}
-	//find corresponding entry and make -1
-	for (int i = 0; i < VIRTUAL_PAGES; i++) {
-		if(pagetable[i]==min_index){
-			pagetable[i]=-1;
-			break;
+	for (int asid = s->next; running > 0; asid = (asid + 1) % n_procs) {
+		const struct trace *t = &traces[asid];
+		if (s->position[asid] == t->count) continue;
+		if (vm->stats.total_addresses >= stop) {
+			s->next = asid;
+			return 0;
+		}
+		vm_switch(vm, asid);
+		size_t end = s->position[asid] + quantum < t->count ? s->position[asid] + quantum : t->count;
+		if (out == NULL) {
+			vm_run(vm, t->addrs + s->position[asid], end - s->position[asid]);
+		} else {
+			for (size_t k = s->position[asid]; k < end; k++) {
+				uint32_t logical_address = t->addrs[k];
+				if (overlap && !s->faulted[asid] && vm_fault_ahead(vm, logical_address)) {
+					s->faulted[asid] = VM_PAGE_FAULT;
+					end = k;
+					break;
+				}
+				unsigned flags = s->faulted[asid];
+				s->faulted[asid] = 0;
+				uint32_t physical_address;
+				if (t->ops && t->ops[k] == TRACE_WRITE) physical_address = vm_write(vm, logical_address, t->values[k], &flags);
+				else physical_address = vm_translate(vm, logical_address, &flags);
+				signed char value = vm_load(vm, physical_address);
+				output_translation(out, logical_address, physical_address, value, flags, asid);
+				if (window) window_record(window, asid, logical_address, flags);
+			}
 		}
+		s->position[asid] = end;
+		if (end == t->count) running--;
 	}
-	
-	return min_index;
-}
-int max(int a, int b)
-{
-	if (a > b) return a;
-  	return b;
+	return 1;
 }
 
-/* Returns the physical address from TLB or -1 if not present. */
-int search_tlb(int logical_page) {
-    for(int i = 0; i < TLB_SIZE; i++){
-    	if(tlb[i].logical == logical_page) return tlb[i].physical;
-    }
-    return -1;
-}
-
-/* Adds the specified mapping to the TLB, replacing the oldest mapping (FIFO replacement). */
-void add_to_tlb(int logical, int physical) {
-	struct tlbentry new_entry = {logical, physical};
-    tlb[tlbindex++ % TLB_SIZE] = new_entry;
+/* Saves vm with the schedule, as the next process followed by the position and fault flag of each,
+ * and the backing store if the traces write. offset is added to the positions, for a trace streamed in chunks. */
+void save_checkpoint(struct vm *vm, const char *path, const struct schedule *s, int n_procs, uint64_t offset, int has_writes)
+{
+	uint64_t state[1 + 2 * MAX_LIST];
+	state[0] = s->next;
+	for (int asid = 0; asid < n_procs; asid++) {
+		state[1 + asid] = s->position[asid] + offset;
+		state[1 + n_procs + asid] = s->faulted[asid];
+	}
+	if (checkpoint_save(vm, path, state, 1 + 2 * n_procs, has_writes) < 0) fprintf(stderr, "Cannot write checkpoint %s: %s\n", path, strerror(errno));
 }
 
 int main(int argc, const char *argv[])
 {
-	if (argc != 5 && strcmp(argv[3],"-p")!=0) {
-	fprintf(stderr, "Usage ./part2 backingstore input -p * (0 for FIFO or 1 for LRU)\n");
-	exit(1);
+	if (argc < 3 || argc % 2 == 0) usage();
+	int output_mode = OUTPUT_TEXT;
+	const char *window_filename = NULL;
+	long window_length = WINDOW_LENGTH;
+	int streaming = 0;
+	int mode = MODE_SIM;
+	int threads[MAX_LIST] = {sysconf(_SC_NPROCESSORS_ONLN)};
+	int n_threads = 1;
+	int quantum = QUANTUM;
+	int write_back = 0;
+	const char *checkpoint_filename = NULL, *resume_filename = NULL;
+	uint64_t checkpoint_interval = CHECKPOINT_INTERVAL;
+	int policies[MAX_LIST] = {REPLACE_FIFO}, frames[MAX_LIST] = {PHYSICAL_PAGES}, tlb_sizes[MAX_LIST] = {TLB_SIZE};
+	int n_policies = 1, n_frames = 1, n_tlb_sizes = 1;
+	struct vm_config config = {OFFSET_BITS, VIRTUAL_BITS, PHYSICAL_BITS, PHYSICAL_PAGES, REPLACE_FIFO, TLB_SIZE, TLB_WAYS, TLB_FIFO, 1, 1, PT_LEVELS, 0, 0, ZERO_COPY};
+	for (int i = 3; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-o") == 0) output_mode = output_parse_mode(argv[i+1]);
+		else if (strcmp(argv[i], "-p") == 0) n_policies = parse_list(argv[i+1], policies, MAX_LIST);
+		else if (strcmp(argv[i], "-f") == 0) n_frames = parse_list(argv[i+1], frames, MAX_LIST);
+		else if (strcmp(argv[i], "-t") == 0) n_tlb_sizes = parse_list(argv[i+1], tlb_sizes, MAX_LIST);
+		else if (strcmp(argv[i], "-a") == 0) config.tlb_ways = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-r") == 0) config.tlb_policy = tlb_parse_policy(argv[i+1]);
+		else if (strcmp(argv[i], "-T") == 0) config.l2_size = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-A") == 0) config.l2_ways = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-I") == 0 && strcmp(argv[i+1], "inclusive") == 0) config.l2_exclusive = 0;
+		else if (strcmp(argv[i], "-I") == 0 && strcmp(argv[i+1], "exclusive") == 0) config.l2_exclusive = 1;
+		else if (strcmp(argv[i], "-l") == 0) {
+			if (vm_parse_latency(argv[i+1], &config.latency) < 0) usage();
+		}
+		else if (strcmp(argv[i], "-j") == 0) n_threads = parse_list(argv[i+1], threads, MAX_LIST);
+		else if (strcmp(argv[i], "-q") == 0) quantum = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-w") == 0) write_back = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-b") == 0) config.write_batch = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-s") == 0) config.offset_bits = vm_parse_page_size(argv[i+1]);
+		else if (strcmp(argv[i], "-v") == 0) config.virtual_bits = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-P") == 0) config.physical_bits = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-L") == 0) config.pt_levels = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-k") == 0) config.prefetch = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-x") == 0) window_filename = argv[i+1];
+		else if (strcmp(argv[i], "-W") == 0) window_length = atol(argv[i+1]);
+		else if (strcmp(argv[i], "-S") == 0) streaming = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-z") == 0) config.zero_copy = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-Q") == 0) config.io_depth = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-H") == 0) config.superpage_bits = vm_parse_superpage(argv[i+1]);
+		else if (strcmp(argv[i], "-C") == 0) checkpoint_filename = argv[i+1];
+		else if (strcmp(argv[i], "-c") == 0) checkpoint_interval = strtoull(argv[i+1], NULL, 10);
+		else if (strcmp(argv[i], "-R") == 0) resume_filename = argv[i+1];
+		else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i+1], "sim") == 0) mode = MODE_SIM;
+		else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i+1], "mrc") == 0) mode = MODE_MRC;
+		else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i+1], "sweep") == 0) mode = MODE_SWEEP;
+		else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i+1], "smp") == 0) mode = MODE_SMP;
+		else usage();
 	}
-	int p = atoi(argv[4]);
-	const char *backing_filename = argv[1]; 
-	int backing_fd = open(backing_filename, O_RDONLY);
-	backing = mmap(0, MEMORY_SIZE, PROT_READ, MAP_PRIVATE, backing_fd, 0); 
-
-	const char *input_filename = argv[2];
-	FILE *input_fp = fopen(input_filename, "r");
+	// an L2 TLB is there to compare latencies, so it turns the latency model on
+	if (config.l2_size && config.latency.memory == 0) vm_parse_latency("", &config.latency);
+	if (output_mode < 0 || (int)config.tlb_policy < 0 || config.offset_bits < 0 || config.superpage_bits < 0 || quantum < 1 || n_policies < 1 || n_frames < 1 || n_tlb_sizes < 1 || n_threads < 1) usage();
+	for (int i = 0; i < n_policies; i++) {
+		if (policies[i] < 0 || policies[i] >= REPLACE_POLICIES) usage();
+	}
+	// lists only make sense when sweeping
+	if (mode != MODE_SWEEP && (n_policies > 1 || n_frames > 1 || n_tlb_sizes > 1)) usage();
+	if (mode != MODE_SMP && n_threads > 1) usage();
+	if (window_filename && mode != MODE_SIM) usage();
+	// windows are numbered from the start of the trace
+	if (((checkpoint_filename || resume_filename) && mode != MODE_SIM) || (resume_filename && window_filename) || checkpoint_interval == 0) usage();
+	config.policy = policies[0];
+	config.frames = frames[0];
+	config.tlb_size = tlb_sizes[0];
 
-	// Fill page table entries with -1 for initially empty table.
-	int i;
-	for (i = 0; i < VIRTUAL_PAGES; i++) {
-		pagetable[i] = -1;
+	// one trace per process
+	char *input_filenames[MAX_LIST];
+	struct trace traces[MAX_LIST];
+	int n_procs = 0;
+	int has_writes = 0;
+	char *inputs = strdup(argv[2]);
+	for (char *name = strtok(inputs, ","); name != NULL; name = strtok(NULL, ",")) {
+		if (n_procs == MAX_LIST) usage();
+		input_filenames[n_procs] = name;
+		if (strcmp(name, "-") == 0) streaming = 1;
+		// a streamed input is only opened once the simulation starts
+		if (streaming) memset(&traces[n_procs], 0, sizeof(struct trace));
+		else if (trace_open(&traces[n_procs], name) < 0) exit(1);
+		if (traces[n_procs].ops) has_writes = 1;
+		n_procs++;
 	}
-	
-	for (i = 0; i < PHYSICAL_PAGES; i++) {
-		counter_pagetable[i] = INT_MAX;
+	if (n_procs == 0 || ((n_procs > 1 || has_writes) && mode != MODE_SIM) || (has_writes && config.zero_copy)) usage();
+	// page reads go to the file, which only sees written pages when they are written back
+	if (has_writes && config.io_depth && !write_back) usage();
+	if (streaming && (n_procs > 1 || mode != MODE_SIM)) usage();
+	// OPT looks ahead in the one trace, which has to be loaded
+	int opt = 0;
+	for (int i = 0; i < n_policies; i++) opt |= policies[i] == REPLACE_OPT;
+	if (opt && (streaming || n_procs > 1)) usage();
+	struct trace trace = traces[0];
+	config.address_spaces = n_procs;
+
+	if (mode == MODE_MRC) {
+		struct mrc mrc;
+		if (config.virtual_bits > 32 || config.offset_bits >= config.virtual_bits) usage();
+		// only the low virtual_bits of an address are used, as in a simulation
+		uint32_t *pages = malloc(trace.count * sizeof(uint32_t) + 1);
+		for (size_t k = 0; k < trace.count; k++) pages[k] = (uint32_t)((uint64_t)trace.addrs[k] & ((1ull << config.virtual_bits) - 1));
+		int failed = mrc_compute(&mrc, pages, trace.count, config.offset_bits, (size_t)1 << (config.virtual_bits - config.offset_bits));
+		free(pages);
+		if (failed) {
+			fprintf(stderr, "Out of memory computing the miss-ratio curve\n");
+			exit(1);
+		}
+		mrc_print(stdout, &mrc, 0);
+		mrc_free(&mrc);
+		trace_close(&trace);
+		free(inputs);
+		return 0;
 	}
 
+	// positions of the next reference to each address's page, computed once for every OPT instance
+	uint64_t *next_use = NULL;
+	if (opt && config.virtual_bits <= 32 && config.offset_bits < config.virtual_bits) {
+		next_use = replace_next_use(trace.addrs, trace.count, config.offset_bits, (size_t)1 << (config.virtual_bits - config.offset_bits));
+	}
+	config.next_use = next_use;
 
-	// Character buffer for reading lines of input file.
-	char buffer[BUFFER_SIZE];
+	const char *backing_filename = argv[1];
+	struct backing_store backing;
+	if (backing_open(&backing, backing_filename, write_back && mode == MODE_SIM) < 0) exit(1);
 
-	// Data we need to keep track of to compute stats at end.
-	int total_addresses = 0;
-	int tlb_hits = 0;
-	int page_faults = 0;
-	// Number of the next unallocated physical page in main memory
-	unsigned char free_page = 0;
+	if (mode == MODE_SWEEP) {
+		int n = n_tlb_sizes * n_frames * n_policies;
+		struct sweep_result *results = calloc(n, sizeof(struct sweep_result));
+		int k = 0;
+		for (int t = 0; t < n_tlb_sizes; t++) {
+			for (int f = 0; f < n_frames; f++) {
+				for (int p = 0; p < n_policies; p++) {
+					results[k].config = config;
+					results[k].config.tlb_size = tlb_sizes[t];
+					results[k].config.frames = frames[f];
+					results[k].config.policy = policies[p];
+					k++;
+				}
+			}
+		}
+		sweep_run(results, n, trace.addrs, trace.count, &backing, threads[0]);
+		printf("Number of Translated Addresses = %zu\n", trace.count);
+		sweep_print(stdout, results, n);
+		free(results);
+		free(next_use);
+		trace_close(&trace);
+		free(inputs);
+		backing_close(&backing);
+		return 0;
+	}
 
-	while (fgets(buffer, BUFFER_SIZE, input_fp) != NULL) {
-		total_addresses++;
-		int logical_address = atoi(buffer);
+	if (mode == MODE_SMP) {
+		for (int i = 0; i < n_threads; i++) {
+			struct smp smp;
+			if (smp_init(&smp, &config, &backing, threads[i]) < 0) {
+				fprintf(stderr, "Invalid configuration: smp mode takes 1 to %d CPUs, FIFO or CLOCK replacement and none of -k, -H, -T, -Q or -z\n", SMP_MAX_CPUS);
+				exit(1);
+			}
+			if (i == 0) {
+				printf("Number of Translated Addresses = %zu\n", trace.count);
+				printf("%8s %12s %8s %12s %8s %12s %12s %12s %10s %12s\n", "CPUs", "Page Faults", "PF Rate", "TLB Hits", "TLB Rate",
+					"Shootdowns", "Received", "Flushed", "Mtrans/s", "Value Sum");
+			}
+			smp_run(&smp, trace.addrs, trace.count);
+			const struct smp_stats *s = &smp.stats;
+			double total = s->total_addresses ? s->total_addresses : 1;
+			printf("%8d %12llu %8.3f %12llu %8.3f %12llu %12llu %12llu %10.2f %12lld\n", threads[i],
+				(unsigned long long)s->page_faults, s->page_faults / total,
+				(unsigned long long)s->tlb_hits, s->tlb_hits / total,
+				(unsigned long long)s->shootdowns, (unsigned long long)s->shootdowns_received,
+				(unsigned long long)s->shootdown_flushes,
+				smp.seconds > 0 ? s->total_addresses / smp.seconds * 1e-6 : 0., (long long)s->value_sum);
+			smp_free(&smp);
+		}
+		trace_close(&trace);
+		free(inputs);
+		backing_close(&backing);
+		return 0;
+	}
 
-		/* Calculate the page offset and logical page number from logical_address */
-		int offset = logical_address & OFFSET_MASK;
-		int logical_page = (logical_address & PAGE_MASK) >> OFFSET_BITS;
-		int physical_page = search_tlb(logical_page);
+	struct vm vm;
+	if (vm_init(&vm, &config, &backing) < 0) {
+		fprintf(stderr, "Invalid configuration: address widths must be at most 32 and larger than the page offset, 1 to 4 page table levels, frames must fit in physical memory, write batch between 1 and %d and TLB size / ways a power of two (and ways too for plru)\n", MAX_WRITE_BATCH);
+		exit(1);
+	}
 
-		// TLB hit
-		if (physical_page != -1) {
-	  		tlb_hits++;
-	  		// TLB miss
-		} else {
-	  		physical_page = pagetable[logical_page];
-	 		// Page fault
-	 		if (physical_page == -1) {
-		 		page_faults++;
-	  	 		if(flag){
-	  	 		//page replacement
-	  	 			if(p){
-	  	 				free_page = lru_page_replacement();
-	  	 				//below is same with part 1
-						memcpy(main_memory + free_page*PAGE_SIZE, backing + logical_page * PAGE_SIZE, PAGE_SIZE);
-						physical_page = free_page;
-						pagetable[logical_page] = physical_page;
-	  	 			}else{
-	  	 				fifo_page_replacement(free_page);
-	  	 				//below is same with part 1
-	  	 				memcpy(main_memory + free_page*PAGE_SIZE, backing + logical_page * PAGE_SIZE, PAGE_SIZE);
-	  	 				physical_page = free_page++;
-						pagetable[logical_page] = physical_page;
-	  	 			}
-	  	 		}else{
-		  	 		memcpy(main_memory + free_page*PAGE_SIZE, backing + logical_page * PAGE_SIZE, PAGE_SIZE);
-		  	 		if(free_page==255) flag = 1;
-		  			physical_page = free_page++;
-					pagetable[logical_page] = physical_page;
-				}
+	struct schedule sched = {{0}};
+	if (resume_filename) {
+		uint64_t state[1 + 2 * MAX_LIST];
+		int result = checkpoint_load(&vm, resume_filename, state, 1 + 2 * n_procs);
+		if (result == -1) fprintf(stderr, "Cannot read checkpoint %s: %s\n", resume_filename, strerror(errno));
+		if (result == -2 || (result == 0 && state[0] >= (uint64_t)n_procs)) fprintf(stderr, "%s is not a checkpoint of this configuration\n", resume_filename);
+		if (result < 0 || state[0] >= (uint64_t)n_procs) exit(1);
+		sched.next = state[0];
+		for (int asid = 0; asid < n_procs; asid++) {
+			sched.position[asid] = state[1 + asid];
+			sched.faulted[asid] = state[1 + n_procs + asid];
+			if (!streaming && sched.position[asid] > traces[asid].count) {
+				fprintf(stderr, "%s is past the end of %s\n", resume_filename, input_filenames[asid]);
+				exit(1);
 			}
-			add_to_tlb(logical_page, physical_page);
 		}
-		counter_pagetable[physical_page] = total_addresses;//like counter implementation of LRU.
-		int physical_address = (physical_page << OFFSET_BITS) | offset;
-		signed char value = main_memory[physical_address];
-		printf("Virtual address: %d Physical address: %d Value: %d\n", logical_address, physical_address, value);
+	}
+	// translated addresses at which the next checkpoint is taken
+	uint64_t next_checkpoint = checkpoint_filename ? vm.stats.total_addresses + checkpoint_interval : UINT64_MAX;
 
+	struct window window;
+	if (window_filename && (window_length <= 0 || window_open(&window, window_filename, window_length, &vm) < 0)) usage();
+
+	// the same traces with base pages only, for comparison
+	struct vm base;
+	struct vm_config base_config = config;
+	base_config.superpage_bits = 0;
+	// the base run is not in the checkpoint, so a resumed run has nothing to compare with
+	int compare = config.superpage_bits && !resume_filename;
+	if (compare && vm_init(&base, &base_config, &backing) < 0) {
+		fprintf(stderr, "Invalid configuration for the base page comparison\n");
+		exit(1);
 	}
 
+	struct output out;
+	output_init(&out, output_mode);
 
-	printf("Number of Translated Addresses = %d\n", total_addresses);
-	printf("Page Faults = %d\n", page_faults);
-	printf("Page Fault Rate = %.3f\n", page_faults / (1. * total_addresses));
-	printf("TLB Hits = %d\n", tlb_hits);
-	printf("TLB Hit Rate = %.3f\n", tlb_hits / (1. * total_addresses));
+	struct window *w = window_filename ? &window : NULL;
+	if (streaming) {
+		struct trace_stream stream;
+		if (trace_stream_open(&stream, input_filenames[0]) < 0) exit(1);
+		const struct trace_chunk *chunk;
+		// addresses read from the stream before this chunk, and where the checkpoint left off
+		uint64_t seen = 0, resume_position = sched.position[0];
+		while ((chunk = trace_stream_next(&stream)) != NULL) {
+			struct trace t = {chunk->addrs, chunk->count};
+			if (chunk->has_ops) {
+				t.ops = chunk->ops;
+				t.values = chunk->values;
+				has_writes = 1;
+				if (config.zero_copy) {
+					fprintf(stderr, "%s has writes, which zero-copy frames cannot take\n", input_filenames[0]);
+					exit(1);
+				}
+				if (config.io_depth && !write_back) {
+					fprintf(stderr, "%s has writes, which page reads from the file only see with -w 1\n", input_filenames[0]);
+					exit(1);
+				}
+			}
+			// the schedule of the one process starts over in each chunk, past what the checkpoint covered
+			sched.position[0] = seen < resume_position ? (resume_position - seen < t.count ? resume_position - seen : t.count) : 0;
+			while (!run_processes(&vm, &t, 1, quantum, &out, w, &sched, next_checkpoint)) {
+				save_checkpoint(&vm, checkpoint_filename, &sched, 1, seen, has_writes);
+				while (next_checkpoint <= vm.stats.total_addresses) next_checkpoint += checkpoint_interval;
+			}
+			if (compare) {
+				struct schedule base_sched = {{0}};
+				run_processes(&base, &t, 1, quantum, NULL, NULL, &base_sched, UINT64_MAX);
+			}
+			seen += t.count;
+		}
+		if (stream.error) exit(1);
+		if (seen < resume_position) {
+			fprintf(stderr, "%s is past the end of %s\n", resume_filename, input_filenames[0]);
+			exit(1);
+		}
+		trace_stream_close(&stream);
+	} else {
+		while (!run_processes(&vm, traces, n_procs, quantum, &out, w, &sched, next_checkpoint)) {
+			save_checkpoint(&vm, checkpoint_filename, &sched, n_procs, 0, has_writes);
+			while (next_checkpoint <= vm.stats.total_addresses) next_checkpoint += checkpoint_interval;
+		}
+		if (compare) {
+			struct schedule base_sched = {{0}};
+			run_processes(&base, traces, n_procs, quantum, NULL, NULL, &base_sched, UINT64_MAX);
+		}
+	}
+	if (window_filename) window_close(&window);
+	if (has_writes) vm_sync(&vm);
+
+	output_vm_stats(&out, &vm);
+	if (compare) {
+		output_tlb_comparison(&out, &vm, &base);
+		vm_free(&base);
+	}
+	if (n_procs > 1) {
+		output_printf(&out, "Context Switches = %llu\n", (unsigned long long)vm.stats.context_switches);
+		for (int asid = 0; asid < n_procs; asid++) {
+			const struct vm_stats *s = &vm.space[asid].stats;
+			double total = s->total_addresses ? s->total_addresses : 1;
+			output_printf(&out, "Process %d (%s): Translated Addresses = %llu Page Faults = %llu Page Fault Rate = %.3f TLB Hits = %llu TLB Hit Rate = %.3f\n",
+				asid, input_filenames[asid], (unsigned long long)s->total_addresses,
+				(unsigned long long)s->page_faults, s->page_faults / total,
+				(unsigned long long)s->tlb_hits, s->tlb_hits / total);
+		}
+	}
+	output_close(&out);
 
+	vm_free(&vm);
+	free(next_use);
+	for (int asid = 0; asid < n_procs; asid++) trace_close(&traces[asid]);
+	free(inputs);
+	backing_close(&backing);
 	return 0;
 }
@@ -0,0 +1,367 @@
+/**
+ * replace.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replace.h"
+
+const char *replace_policy_names[REPLACE_POLICIES] = {"FIFO", "LRU", "CLOCK", "second-chance", "LFU", "OPT"};
+
+static void *xcalloc(size_t n, size_t size)
+{
+	void *p = calloc(n, size);
+	if (p == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	return p;
+}
+
+void replacer_init(struct replacer *r, enum replace_policy policy, int frames)
+{
+	memset(r, 0, sizeof(*r));
+	r->policy = policy;
+	r->frames = frames;
+	r->ref = xcalloc(frames, sizeof(uint8_t));
+	// free frames are not tracked until their first insert either
+	r->taken = xcalloc(frames, sizeof(uint8_t));
+	memset(r->taken, 1, frames);
+	r->prev = xcalloc(frames, sizeof(int));
+	r->next = xcalloc(frames, sizeof(int));
+	r->head = r->tail = -1;
+	r->pinned = -1;
+	r->bucket_of = xcalloc(frames, sizeof(int));
+	// there are never more distinct use counts than frames
+	r->buckets = xcalloc(frames + 1, sizeof(struct lfu_bucket));
+	r->bucket_head = -1;
+	for (int i = 0; i <= frames; i++) r->buckets[i].next = i < frames ? i + 1 : -1;
+	r->bucket_free = 0;
+	if (policy == REPLACE_OPT) {
+		r->key = xcalloc(frames, sizeof(uint64_t));
+		r->heap = xcalloc(frames, sizeof(int));
+		r->heap_pos = xcalloc(frames, sizeof(int));
+	}
+}
+
+void replacer_free(struct replacer *r)
+{
+	free(r->ref);
+	free(r->taken);
+	free(r->prev);
+	free(r->next);
+	free(r->bucket_of);
+	free(r->buckets);
+	free(r->key);
+	free(r->heap);
+	free(r->heap_pos);
+	memset(r, 0, sizeof(*r));
+}
+
+static void list_remove(struct replacer *r, int *head, int *tail, int frame)
+{
+	int p = r->prev[frame], n = r->next[frame];
+	if (p != -1) r->next[p] = n; else *head = n;
+	if (n != -1) r->prev[n] = p; else *tail = p;
+}
+
+static void list_append(struct replacer *r, int *head, int *tail, int frame)
+{
+	r->prev[frame] = *tail;
+	r->next[frame] = -1;
+	if (*tail != -1) r->next[*tail] = frame; else *head = frame;
+	*tail = frame;
+}
+
+static void list_prepend(struct replacer *r, int *head, int *tail, int frame)
+{
+	r->prev[frame] = -1;
+	r->next[frame] = *head;
+	if (*head != -1) r->prev[*head] = frame; else *tail = frame;
+	*head = frame;
+}
+
+void lru_move_to_tail(struct replacer *r, int frame)
+{
+	list_remove(r, &r->head, &r->tail, frame);
+	list_append(r, &r->head, &r->tail, frame);
+}
+
+/* Takes a bucket for freq from the free list and links it after prev (-1 for the front). */
+static int lfu_new_bucket(struct replacer *r, uint32_t freq, int prev)
+{
+	int b = r->bucket_free;
+	struct lfu_bucket *nb = &r->buckets[b];
+	r->bucket_free = nb->next;
+	nb->freq = freq;
+	nb->head = nb->tail = -1;
+	nb->prev = prev;
+	nb->next = prev == -1 ? r->bucket_head : r->buckets[prev].next;
+	if (nb->next != -1) r->buckets[nb->next].prev = b;
+	if (prev == -1) r->bucket_head = b; else r->buckets[prev].next = b;
+	return b;
+}
+
+static void lfu_remove(struct replacer *r, int frame)
+{
+	int b = r->bucket_of[frame];
+	struct lfu_bucket *ob = &r->buckets[b];
+	list_remove(r, &ob->head, &ob->tail, frame);
+	if (ob->head != -1) return;
+	// bucket is empty, unlink and free it
+	if (ob->prev != -1) r->buckets[ob->prev].next = ob->next; else r->bucket_head = ob->next;
+	if (ob->next != -1) r->buckets[ob->next].prev = ob->prev;
+	ob->next = r->bucket_free;
+	r->bucket_free = b;
+}
+
+void lfu_increment(struct replacer *r, int frame)
+{
+	int b = r->bucket_of[frame];
+	// the count saturates, a wrapped one would sort before every other bucket; the frame becomes the bucket's most recent
+	if (r->buckets[b].freq == UINT32_MAX) {
+		struct lfu_bucket *ob = &r->buckets[b];
+		list_remove(r, &ob->head, &ob->tail, frame);
+		list_append(r, &ob->head, &ob->tail, frame);
+		return;
+	}
+	uint32_t freq = r->buckets[b].freq + 1;
+	int nb = r->buckets[b].next;
+	if (nb == -1 || r->buckets[nb].freq != freq) nb = lfu_new_bucket(r, freq, b);
+	lfu_remove(r, frame);
+	list_append(r, &r->buckets[nb].head, &r->buckets[nb].tail, frame);
+	r->bucket_of[frame] = nb;
+}
+
+uint64_t *replace_next_use(const uint32_t *addrs, size_t n, int offset_bits, size_t virtual_pages)
+{
+	uint64_t *next_use = xcalloc(n, sizeof(uint64_t));
+	uint64_t *seen = xcalloc(virtual_pages, sizeof(uint64_t));
+	for (size_t p = 0; p < virtual_pages; p++) seen[p] = REPLACE_NEVER;
+	for (size_t i = n; i-- > 0;) {
+		uint32_t page = (addrs[i] >> offset_bits) & (virtual_pages - 1);
+		next_use[i] = seen[page];
+		seen[page] = i;
+	}
+	free(seen);
+	return next_use;
+}
+
+static void heap_set(struct replacer *r, int i, int frame)
+{
+	r->heap[i] = frame;
+	r->heap_pos[frame] = i;
+}
+
+/* Restores the heap order around index i after the key there changed. */
+static void heap_fix(struct replacer *r, int i)
+{
+	int frame = r->heap[i];
+	uint64_t key = r->key[frame];
+	while (i > 0 && r->key[r->heap[(i - 1) / 2]] < key) {
+		heap_set(r, i, r->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= r->heap_len) break;
+		if (child + 1 < r->heap_len && r->key[r->heap[child + 1]] > r->key[r->heap[child]]) child++;
+		if (r->key[r->heap[child]] <= key) break;
+		heap_set(r, i, r->heap[child]);
+		i = child;
+	}
+	heap_set(r, i, frame);
+}
+
+/* Takes the frame at index i out of the heap. */
+static void heap_remove(struct replacer *r, int i)
+{
+	r->heap_len--;
+	if (i < r->heap_len) {
+		heap_set(r, i, r->heap[r->heap_len]);
+		heap_fix(r, i);
+	}
+}
+
+void opt_access(struct replacer *r, int frame)
+{
+	r->key[frame] = r->next_use[r->position++];
+	heap_fix(r, r->heap_pos[frame]);
+}
+
+void replacer_insert(struct replacer *r, int frame)
+{
+	r->taken[frame] = 0;
+	switch (r->policy) {
+	case REPLACE_LRU:
+	case REPLACE_SECOND_CHANCE:
+		r->ref[frame] = 0;
+		list_append(r, &r->head, &r->tail, frame);
+		break;
+	case REPLACE_CLOCK:
+		r->ref[frame] = 0;
+		break;
+	case REPLACE_LFU: {
+		int b = r->bucket_head;
+		if (b == -1 || r->buckets[b].freq != 0) b = lfu_new_bucket(r, 0, -1);
+		list_append(r, &r->buckets[b].head, &r->buckets[b].tail, frame);
+		r->bucket_of[frame] = b;
+		break;
+	}
+	case REPLACE_OPT:
+		// until its first reference the page counts as never used, a read-ahead page goes first
+		r->key[frame] = REPLACE_NEVER;
+		heap_set(r, r->heap_len++, frame);
+		heap_fix(r, r->heap_len - 1);
+		break;
+	default:
+		break;
+	}
+}
+
+void replacer_insert_cold(struct replacer *r, int frame)
+{
+	r->taken[frame] = 0;
+	switch (r->policy) {
+	case REPLACE_LRU:
+	case REPLACE_SECOND_CHANCE:
+		r->ref[frame] = 0;
+		list_prepend(r, &r->head, &r->tail, frame);
+		break;
+	default:
+		// CLOCK and LFU frames are cold until referenced, FIFO has no order to choose
+		replacer_insert(r, frame);
+		break;
+	}
+}
+
+static void relabel(int *p, int a, int b)
+{
+	if (*p == a) *p = b;
+	else if (*p == b) *p = a;
+}
+
+/* Exchanges the positions of frames a and b, which may be in different lists. */
+static void list_swap(struct replacer *r, int *head_a, int *tail_a, int *head_b, int *tail_b, int a, int b)
+{
+	int nodes[6] = {a, b, r->prev[a], r->next[a], r->prev[b], r->next[b]};
+	int t = r->prev[a];
+	r->prev[a] = r->prev[b];
+	r->prev[b] = t;
+	t = r->next[a];
+	r->next[a] = r->next[b];
+	r->next[b] = t;
+	// every link that pointed at a now points at b and the other way round; fix each node once
+	for (int i = 0; i < 6; i++) {
+		int x = nodes[i], seen = x == -1;
+		for (int j = 0; j < i && !seen; j++) seen = nodes[j] == x;
+		if (seen) continue;
+		relabel(&r->prev[x], a, b);
+		relabel(&r->next[x], a, b);
+	}
+	relabel(head_a, a, b);
+	relabel(tail_a, a, b);
+	if (head_b != head_a) {
+		relabel(head_b, a, b);
+		relabel(tail_b, a, b);
+	}
+}
+
+void replacer_swap(struct replacer *r, int a, int b)
+{
+	if (a == b) return;
+	uint8_t ref = r->ref[a];
+	r->ref[a] = r->ref[b];
+	r->ref[b] = ref;
+	uint8_t taken = r->taken[a];
+	r->taken[a] = r->taken[b];
+	r->taken[b] = taken;
+	switch (r->policy) {
+	case REPLACE_LRU:
+	case REPLACE_SECOND_CHANCE:
+		list_swap(r, &r->head, &r->tail, &r->head, &r->tail, a, b);
+		break;
+	case REPLACE_LFU: {
+		struct lfu_bucket *ba = &r->buckets[r->bucket_of[a]], *bb = &r->buckets[r->bucket_of[b]];
+		list_swap(r, &ba->head, &ba->tail, &bb->head, &bb->tail, a, b);
+		int bucket = r->bucket_of[a];
+		r->bucket_of[a] = r->bucket_of[b];
+		r->bucket_of[b] = bucket;
+		break;
+	}
+	case REPLACE_OPT: {
+		uint64_t key = r->key[a];
+		r->key[a] = r->key[b];
+		r->key[b] = key;
+		int pa = r->heap_pos[a], pb = r->heap_pos[b];
+		heap_set(r, pa, b);
+		heap_set(r, pb, a);
+		break;
+	}
+	default:
+		// FIFO order is the frame order, so the pages take the age of the frame they move to
+		break;
+	}
+}
+
+/* Picks the victim; replacer_victim marks it taken. */
+static int pick_victim(struct replacer *r)
+{
+	int frame;
+	switch (r->policy) {
+	case REPLACE_LRU:
+		frame = r->head == r->pinned ? r->next[r->head] : r->head;
+		list_remove(r, &r->head, &r->tail, frame);
+		return frame;
+	case REPLACE_CLOCK:
+		// sweep the hand over the frames, clearing reference bits until an unreferenced one
+		while (r->ref[r->hand] || r->hand == r->pinned || r->taken[r->hand]) {
+			r->ref[r->hand] = 0;
+			r->hand = (r->hand + 1) % r->frames;
+		}
+		frame = r->hand;
+		r->hand = (r->hand + 1) % r->frames;
+		return frame;
+	case REPLACE_SECOND_CHANCE:
+		// referenced pages at the front of the queue go to the back with their bit cleared
+		while (r->ref[r->head] || r->head == r->pinned) {
+			frame = r->head;
+			r->ref[frame] = 0;
+			lru_move_to_tail(r, frame);
+		}
+		frame = r->head;
+		list_remove(r, &r->head, &r->tail, frame);
+		return frame;
+	case REPLACE_LFU: {
+		// the pinned frame may be the only one in the lowest bucket, then the next bucket has the victim
+		const struct lfu_bucket *b = &r->buckets[r->bucket_head];
+		frame = b->head;
+		if (frame == r->pinned) frame = r->next[frame] != -1 ? r->next[frame] : r->buckets[b->next].head;
+		lfu_remove(r, frame);
+		return frame;
+	}
+	case REPLACE_OPT: {
+		// under a pinned root the furthest next use is in one of its children
+		int i = 0;
+		if (r->heap[0] == r->pinned) i = r->heap_len > 2 && r->key[r->heap[2]] > r->key[r->heap[1]] ? 2 : 1;
+		frame = r->heap[i];
+		heap_remove(r, i);
+		return frame;
+	}
+	default:
+		// frames are filled in order, so the oldest page is always the one at the hand
+		while (r->hand == r->pinned || r->taken[r->hand]) r->hand = (r->hand + 1) % r->frames;
+		frame = r->hand;
+		r->hand = (r->hand + 1) % r->frames;
+		return frame;
+	}
+}
+
+int replacer_victim(struct replacer *r)
+{
+	int frame = pick_victim(r);
+	r->taken[frame] = 1;
+	return frame;
+}
@@ -0,0 +1,114 @@
+/**
+ * replace.h
+ *
+ * Page replacement policies. Every operation is O(1) (CLOCK and second-chance amortized),
+ * except for OPT, which keeps the frames in a heap and takes O(log frames).
+ */
+
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// next use position of a page that is not referenced again
+#define REPLACE_NEVER UINT64_MAX
+
+// Values of the -p switch.
+enum replace_policy {
+	REPLACE_FIFO = 0,
+	REPLACE_LRU = 1,
+	REPLACE_CLOCK = 2,
+	REPLACE_SECOND_CHANCE = 3,
+	REPLACE_LFU = 4,
+	REPLACE_OPT = 5,	// Belady: evicts the page used furthest in the future, needs the whole trace beforehand
+	REPLACE_POLICIES
+};
+
+struct lfu_bucket {
+	uint32_t freq;
+	// frames with this use count, least recently used first
+	int head, tail;
+	// neighbouring buckets in increasing freq order
+	int prev, next;
+};
+
+struct replacer {
+	enum replace_policy policy;
+	int frames;
+	// FIFO and CLOCK: next frame to look at
+	int hand;
+	// CLOCK and second-chance reference bits
+	uint8_t *ref;
+	// Doubly linked list of frames: LRU order (head is least recent), second-chance queue or LFU bucket
+	int *prev, *next;
+	int head, tail;
+	// LFU: bucket of each frame, bucket list starting at head (smallest freq) and free buckets
+	int *bucket_of;
+	struct lfu_bucket *buckets;
+	int bucket_head;
+	int bucket_free;
+	// OPT: next_use[i] is the position of the next reference to the page of reference i, position the
+	// number of references so far, and a max-heap of the frames by the next use of their page
+	const uint64_t *next_use;
+	uint64_t position;
+	uint64_t *key;
+	int *heap;
+	int *heap_pos;
+	int heap_len;
+	// frame replacer_victim passes over, -1 for none
+	int pinned;
+	// set for a frame that is free or that replacer_victim returned, until it is inserted again;
+	// CLOCK and FIFO keep no list to take it out of, so their hands pass over it
+	uint8_t *taken;
+};
+
+extern const char *replace_policy_names[REPLACE_POLICIES];
+
+void replacer_init(struct replacer *r, enum replace_policy policy, int frames);
+void replacer_free(struct replacer *r);
+
+/* Starts tracking frame after a page was loaded into it. */
+void replacer_insert(struct replacer *r, int frame);
+
+/* Like replacer_insert, but puts frame where it is the next victim unless it gets referenced. */
+void replacer_insert_cold(struct replacer *r, int frame);
+
+/* Exchanges the replacement state of frames a and b, after their pages were swapped. */
+void replacer_swap(struct replacer *r, int a, int b);
+
+/* Picks the frame to evict, never the pinned one, and stops tracking it. All frames must be tracked,
+ * and with a frame pinned there must be another. */
+int replacer_victim(struct replacer *r);
+
+/* Computes next_use for OPT over a trace in one backward pass: for each address, the index of the
+ * next address on the same page (pages as in vm_translate), REPLACE_NEVER if there is none. */
+uint64_t *replace_next_use(const uint32_t *addrs, size_t n, int offset_bits, size_t virtual_pages);
+
+void lru_move_to_tail(struct replacer *r, int frame);
+void opt_access(struct replacer *r, int frame);
+void lfu_increment(struct replacer *r, int frame);
+
+/* Records a reference to the page in frame. */
+static inline void replacer_access(struct replacer *r, int frame)
+{
+	switch (r->policy) {
+	case REPLACE_LRU:
+		if (r->tail != frame) lru_move_to_tail(r, frame);
+		break;
+	case REPLACE_CLOCK:
+	case REPLACE_SECOND_CHANCE:
+		r->ref[frame] = 1;
+		break;
+	case REPLACE_LFU:
+		lfu_increment(r, frame);
+		break;
+	case REPLACE_OPT:
+		opt_access(r, frame);
+		break;
+	default:
+		break;
+	}
+}
+
+#endif
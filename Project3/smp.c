@@ -0,0 +1,210 @@
+/**
+ * smp.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "smp.h"
+
+int smp_init(struct smp *m, const struct vm_config *config, const struct backing_store *store, int cpus)
+{
+	memset(m, 0, sizeof(*m));
+	if (cpus < 1 || cpus > SMP_MAX_CPUS) return -1;
+	if (config->offset_bits < 1 || config->offset_bits >= config->virtual_bits || config->virtual_bits > 32) return -1;
+	if (config->offset_bits >= config->physical_bits || config->physical_bits > 32) return -1;
+	if (config->frames <= 0 || (uint64_t)config->frames > (1ull << (config->physical_bits - config->offset_bits))) return -1;
+	// the CPUs set accessed bits; orders that change on every reference would need the lock for each one
+	if (config->policy != REPLACE_FIFO && config->policy != REPLACE_CLOCK) return -1;
+	if (config->address_spaces != 1 || config->prefetch || config->superpage_bits || config->l2_size || config->io_depth || config->zero_copy) return -1;
+	if (pt_init(&m->pt, config->virtual_bits - config->offset_bits, config->pt_levels) < 0) return -1;
+
+	m->config = *config;
+	m->offset_bits = config->offset_bits;
+	m->page_size = 1u << config->offset_bits;
+	m->virtual_pages = 1u << (config->virtual_bits - config->offset_bits);
+	m->store = store;
+	m->frame_owner = malloc(config->frames * sizeof(int));
+	m->ref = calloc(config->frames, sizeof(uint8_t));
+	m->main_memory = malloc((size_t)config->frames * m->page_size);
+	m->cpus = aligned_alloc(64, cpus * sizeof(struct smp_cpu));
+	if (!m->frame_owner || !m->ref || !m->main_memory || !m->cpus) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(m->frame_owner, 0xff, config->frames * sizeof(int));
+	memset(m->cpus, 0, cpus * sizeof(struct smp_cpu));
+	m->n_cpus = cpus;
+	pthread_mutex_init(&m->lock, NULL);
+	for (int i = 0; i < cpus; i++) {
+		if (tlb_init(&m->cpus[i].tlb, config->tlb_size, config->tlb_ways, config->tlb_policy) < 0) {
+			smp_free(m);
+			return -1;
+		}
+		m->cpus[i].shootdown = -1;
+		m->cpus[i].smp = m;
+	}
+	return 0;
+}
+
+void smp_free(struct smp *m)
+{
+	if (m->cpus) {
+		for (int i = 0; i < m->n_cpus; i++) tlb_free(&m->cpus[i].tlb);
+		pthread_mutex_destroy(&m->lock);
+	}
+	pt_free(&m->pt);
+	free(m->frame_owner);
+	free(m->ref);
+	free(m->main_memory);
+	free(m->cpus);
+	memset(m, 0, sizeof(*m));
+}
+
+/* Drops a page another CPU evicted, if one was posted. CPUs call this between translations,
+ * the point where a real one takes the interrupt. */
+static inline void handle_shootdown(struct smp_cpu *cpu)
+{
+	int page = __atomic_load_n(&cpu->shootdown, __ATOMIC_ACQUIRE);
+	if (page == -1) return;
+	cpu->stats.shootdowns_received++;
+	struct tlb *t = &cpu->tlb;
+	if (tlb_find(t, tlb_set_index(t, 0, page) * t->ways, 0, page) >= 0) {
+		tlb_invalidate(&cpu->tlb, 0, page);
+		cpu->stats.shootdown_flushes++;
+	}
+	// the evicting CPU reuses the frame once every CPU has answered
+	__atomic_store_n(&cpu->shootdown, -1, __ATOMIC_RELEASE);
+}
+
+/* Posts page to every other CPU and waits until each has dropped it or finished. */
+static void shootdown(struct smp *m, struct smp_cpu *self, int page)
+{
+	if (m->n_cpus == 1) return;
+	self->stats.shootdowns++;
+	for (int i = 0; i < m->n_cpus; i++) {
+		struct smp_cpu *cpu = &m->cpus[i];
+		if (cpu != self) __atomic_store_n(&cpu->shootdown, page, __ATOMIC_RELEASE);
+	}
+	for (int i = 0; i < m->n_cpus; i++) {
+		struct smp_cpu *cpu = &m->cpus[i];
+		if (cpu == self) continue;
+		while (__atomic_load_n(&cpu->shootdown, __ATOMIC_ACQUIRE) != -1 && !__atomic_load_n(&cpu->done, __ATOMIC_ACQUIRE)) sched_yield();
+	}
+}
+
+static int smp_victim(struct smp *m)
+{
+	int frames = m->config.frames;
+	if (m->config.policy == REPLACE_CLOCK) {
+		while (__atomic_load_n(&m->ref[m->hand], __ATOMIC_RELAXED)) {
+			__atomic_store_n(&m->ref[m->hand], 0, __ATOMIC_RELAXED);
+			m->hand = (m->hand + 1) % frames;
+		}
+	}
+	int frame = m->hand;
+	m->hand = (m->hand + 1) % frames;
+	return frame;
+}
+
+/* Loads logical_page unless another CPU got there first, and returns its frame. */
+static int smp_page_fault(struct smp *m, struct smp_cpu *cpu, int logical_page)
+{
+	// a CPU waiting for the lock still answers shootdowns, or the one holding it could wait forever
+	while (pthread_mutex_trylock(&m->lock) != 0) {
+		handle_shootdown(cpu);
+		sched_yield();
+	}
+	uint64_t refs = 0;
+	int frame = pt_lookup_shared(&m->pt, logical_page, &refs);
+	if (frame != -1) {
+		pthread_mutex_unlock(&m->lock);
+		return frame;
+	}
+	cpu->stats.page_faults++;
+	if (m->free_page < m->config.frames) {
+		frame = m->free_page++;
+	} else {
+		frame = smp_victim(m);
+		int victim = m->frame_owner[frame];
+		// unmapped first, so that no CPU can put it back in its TLB during the shootdown
+		pt_set(&m->pt, victim, -1);
+		tlb_invalidate(&cpu->tlb, 0, victim);
+		shootdown(m, cpu, victim);
+	}
+
+	size_t start = (size_t)logical_page * m->page_size, size = m->store->size;
+	signed char *dst = m->main_memory + (size_t)frame * m->page_size;
+	if (start + m->page_size <= size) {
+		memcpy(dst, m->store->data + start, m->page_size);
+	} else {
+		memset(dst, 0, m->page_size);
+		if (start < size) memcpy(dst, m->store->data + start, size - start);
+	}
+	m->frame_owner[frame] = logical_page;
+	__atomic_store_n(&m->ref[frame], 0, __ATOMIC_RELAXED);
+	pt_set(&m->pt, logical_page, frame);
+	pthread_mutex_unlock(&m->lock);
+	return frame;
+}
+
+static void *smp_cpu_run(void *arg)
+{
+	struct smp_cpu *cpu = arg;
+	struct smp *m = cpu->smp;
+	uint32_t offset_mask = m->page_size - 1;
+	for (size_t k = 0; k < cpu->count; k++) {
+		handle_shootdown(cpu);
+		uint32_t logical_address = cpu->addrs[k];
+		int logical_page = (logical_address >> m->offset_bits) & (m->virtual_pages - 1);
+		cpu->stats.total_addresses++;
+		int frame = tlb_lookup(&cpu->tlb, 0, logical_page);
+		if (frame != -1) {
+			cpu->stats.tlb_hits++;
+		} else {
+			uint64_t refs = 0;
+			frame = pt_lookup_shared(&m->pt, logical_page, &refs);
+			if (frame == -1) frame = smp_page_fault(m, cpu, logical_page);
+			tlb_insert(&cpu->tlb, 0, logical_page, frame);
+		}
+		// accessed bit, only written when clear so that CPUs sharing hot frames do not fight over the line
+		if (!__atomic_load_n(&m->ref[frame], __ATOMIC_RELAXED)) __atomic_store_n(&m->ref[frame], 1, __ATOMIC_RELAXED);
+		cpu->stats.value_sum += m->main_memory[(size_t)frame * m->page_size + (logical_address & offset_mask)];
+	}
+	__atomic_store_n(&cpu->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+void smp_run(struct smp *m, const uint32_t *addrs, size_t n)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < m->n_cpus; i++) {
+		struct smp_cpu *cpu = &m->cpus[i];
+		size_t first = n * i / m->n_cpus, last = n * (i + 1) / m->n_cpus;
+		cpu->addrs = addrs + first;
+		cpu->count = last - first;
+		if (pthread_create(&cpu->thread, NULL, smp_cpu_run, cpu) != 0) {
+			fprintf(stderr, "Cannot start CPU threads\n");
+			exit(1);
+		}
+	}
+	for (int i = 0; i < m->n_cpus; i++) pthread_join(m->cpus[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	m->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	memset(&m->stats, 0, sizeof(m->stats));
+	for (int i = 0; i < m->n_cpus; i++) {
+		const struct smp_stats *s = &m->cpus[i].stats;
+		m->stats.total_addresses += s->total_addresses;
+		m->stats.tlb_hits += s->tlb_hits;
+		m->stats.page_faults += s->page_faults;
+		m->stats.shootdowns += s->shootdowns;
+		m->stats.shootdowns_received += s->shootdowns_received;
+		m->stats.shootdown_flushes += s->shootdown_flushes;
+		m->stats.value_sum += s->value_sum;
+	}
+}
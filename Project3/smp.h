@@ -0,0 +1,79 @@
+/**
+ * smp.h
+ *
+ * Multiprocessor MMU: several threads, each a CPU with its own TLB, translate parts of one trace
+ * against a shared page table and frame pool. Page table reads take no lock; page faults are
+ * serviced one at a time, and evicting a page shoots it down in the TLBs of the other CPUs.
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vm.h"
+
+// Most CPUs one instance simulates.
+#define SMP_MAX_CPUS 64
+
+struct smp_stats {
+	uint64_t total_addresses;
+	uint64_t tlb_hits;
+	uint64_t page_faults;
+	// evictions that broadcast a shootdown, shootdown messages handled by other CPUs,
+	// and those that found the page in the receiving TLB
+	uint64_t shootdowns;
+	uint64_t shootdowns_received;
+	uint64_t shootdown_flushes;
+	// sum of the bytes read, the same for any number of CPUs if every translation was right
+	int64_t value_sum;
+};
+
+struct smp_cpu {
+	struct tlb tlb;
+	// page to drop from the TLB, posted by the CPU that evicted it and reset to -1 once dropped
+	int shootdown;
+	// set when the CPU has finished its part of the trace and no longer answers shootdowns
+	int done;
+	struct smp_stats stats;
+	struct smp *smp;
+	const uint32_t *addrs;
+	size_t count;
+	pthread_t thread;
+} __attribute__((aligned(64)));
+
+struct smp {
+	struct vm_config config;
+	int offset_bits;
+	uint32_t page_size;
+	uint32_t virtual_pages;
+	const struct backing_store *store;
+	// one address space shared by all CPUs; entries change only under lock
+	struct pagetable pt;
+	int *frame_owner;
+	// accessed bit per frame, set by the CPUs without the lock and cleared by CLOCK
+	uint8_t *ref;
+	signed char *main_memory;
+	int hand;
+	int free_page;
+	// serializes page faults
+	pthread_mutex_t lock;
+	struct smp_cpu *cpus;
+	int n_cpus;
+	struct smp_stats stats;
+	// wall time of smp_run
+	double seconds;
+};
+
+/* Sets up cpus CPUs sharing frames. Takes the address geometry, frames, TLB, page table levels
+ * and policy (FIFO or CLOCK only) from config; other features must be off. Returns 0 or -1. */
+int smp_init(struct smp *m, const struct vm_config *config, const struct backing_store *store, int cpus);
+void smp_free(struct smp *m);
+
+/* Splits the trace into one contiguous part per CPU and translates them in parallel.
+ * Fills m->stats with the totals and m->seconds with the wall time. */
+void smp_run(struct smp *m, const uint32_t *addrs, size_t n);
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * stackdist.c
+ *
+ * A Fenwick tree over trace positions has a 1 at the last reference of every page.
+ * The LRU stack distance of a reference is the number of ones after the previous
+ * reference of the same page, so a reference costs two O(log n) tree operations.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stackdist.h"
+
+static void fenwick_add(int32_t *tree, size_t n, size_t i, int32_t v)
+{
+	for (; i <= n; i += i & -i) tree[i] += v;
+}
+
+static int64_t fenwick_sum(const int32_t *tree, size_t i)
+{
+	int64_t s = 0;
+	for (; i > 0; i -= i & -i) s += tree[i];
+	return s;
+}
+
+int mrc_compute(struct mrc *m, const uint32_t *addrs, size_t n, int offset_bits, size_t virtual_pages)
+{
+	memset(m, 0, sizeof(*m));
+	// positions are 1 based, 0 means never referenced
+	int32_t *tree = calloc(n + 1, sizeof(int32_t));
+	size_t *last = calloc(virtual_pages, sizeof(size_t));
+	// hist[d] is the number of references at stack distance d (d >= 1)
+	uint64_t *hist = calloc(n + 2, sizeof(uint64_t));
+	if (!tree || !last || !hist) {
+		free(tree);
+		free(last);
+		free(hist);
+		return -1;
+	}
+
+	uint64_t cold = 0;
+	for (size_t t = 1; t <= n; t++) {
+		size_t page = addrs[t - 1] >> offset_bits;
+		size_t prev = last[page];
+		if (prev) {
+			// distinct pages referenced after prev, plus this page itself
+			size_t d = fenwick_sum(tree, t - 1) - fenwick_sum(tree, prev) + 1;
+			hist[d]++;
+			fenwick_add(tree, n, prev, -1);
+		} else {
+			cold++;
+			m->distinct++;
+		}
+		fenwick_add(tree, n, t, 1);
+		last[page] = t;
+	}
+
+	// faults with c frames: cold misses plus references at distance greater than c
+	m->total = n;
+	m->faults = malloc((m->distinct + 1) * sizeof(uint64_t));
+	if (m->faults == NULL) {
+		free(tree);
+		free(last);
+		free(hist);
+		return -1;
+	}
+	uint64_t misses = cold;
+	for (size_t c = m->distinct + 1; c-- > 0;) {
+		m->faults[c] = misses;
+		misses += hist[c];
+	}
+
+	free(tree);
+	free(last);
+	free(hist);
+	return 0;
+}
+
+void mrc_print(FILE *fp, const struct mrc *m, size_t max_frames)
+{
+	if (max_frames == 0) max_frames = m->distinct;
+	fprintf(fp, "Number of Translated Addresses = %zu\n", m->total);
+	fprintf(fp, "Distinct Pages = %zu\n", m->distinct);
+	fprintf(fp, "Frames Page Faults Page Fault Rate\n");
+	for (size_t c = 1; c <= max_frames; c++) {
+		uint64_t f = mrc_faults(m, c);
+		fprintf(fp, "%zu %llu %.3f\n", c, (unsigned long long)f, m->total ? f / (1. * m->total) : 0.);
+	}
+}
+
+void mrc_free(struct mrc *m)
+{
+	free(m->faults);
+	memset(m, 0, sizeof(*m));
+}
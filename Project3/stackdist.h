@@ -0,0 +1,37 @@
+/**
+ * stackdist.h
+ *
+ * LRU miss-ratio curve from one pass over a trace (Mattson stack distances).
+ */
+
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct mrc {
+	size_t total;
+	// number of distinct pages, LRU with this many frames only takes cold misses
+	size_t distinct;
+	// faults[c] is the number of page faults with c frames, for 0 <= c <= distinct
+	uint64_t *faults;
+};
+
+/* Computes LRU page fault counts for every number of frames in O(n log n).
+ * Pages are addrs[i] >> offset_bits and must be below virtual_pages. Returns 0 on success. */
+int mrc_compute(struct mrc *m, const uint32_t *addrs, size_t n, int offset_bits, size_t virtual_pages);
+
+/* Page faults of LRU with the given number of frames. */
+static inline uint64_t mrc_faults(const struct mrc *m, size_t frames)
+{
+	return frames >= m->distinct ? m->faults[m->distinct] : m->faults[frames];
+}
+
+/* Prints the curve for 1 .. max_frames frames (all useful sizes when max_frames is 0). */
+void mrc_print(FILE *fp, const struct mrc *m, size_t max_frames);
+
+void mrc_free(struct mrc *m);
+
+#endif
@@ -0,0 +1,210 @@
+/**
+ * stream.c
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "trace.h"
+#include "stream.h"
+
+/* Reads until raw is full or the input ends. Returns -1 on a read error. */
+static int fill_raw(struct trace_stream *s)
+{
+	while (!s->eof && s->raw_len < STREAM_RAW_SIZE) {
+		ssize_t n = read(s->fd, s->raw + s->raw_len, STREAM_RAW_SIZE - s->raw_len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("read");
+			return -1;
+		}
+		if (n == 0) s->eof = 1;
+		s->raw_len += n;
+	}
+	return 0;
+}
+
+/* Parses the next part of the input into c. Returns -1 on a read error. */
+static int parse_chunk(struct trace_stream *s, struct trace_chunk *c)
+{
+	c->count = 0;
+	c->has_ops = 0;
+	if (fill_raw(s) < 0) return -1;
+	if (s->format == -1) {
+		s->format = STREAM_TEXT;
+		if (s->raw_len >= TRACE_MAGIC_LEN && memcmp(s->raw, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) s->format = STREAM_U32;
+		if (s->raw_len >= TRACE_MAGIC_LEN && memcmp(s->raw, TRACE_VARINT_MAGIC, TRACE_MAGIC_LEN) == 0) s->format = STREAM_VARINT;
+		if (s->format != STREAM_TEXT) {
+			memmove(s->raw, s->raw + TRACE_MAGIC_LEN, s->raw_len - TRACE_MAGIC_LEN);
+			s->raw_len -= TRACE_MAGIC_LEN;
+			if (fill_raw(s) < 0) return -1;
+		}
+	}
+
+	size_t used;
+	if (s->format == STREAM_VARINT) {
+		// every whole block that is in raw and fits in the chunk
+		const uint8_t *p = (const uint8_t *)s->raw;
+		used = 0;
+		// a block that could never be whole in raw or in a chunk would otherwise be waited for forever
+		int corrupt = 0, full = 0;
+		while (s->raw_len - used >= TRACE_BLOCK_HEADER) {
+			const uint8_t *h = p + used;
+			uint32_t count = h[0] | h[1] << 8 | h[2] << 16 | (uint32_t)h[3] << 24;
+			uint32_t bytes = h[4] | h[5] << 8 | h[6] << 16 | (uint32_t)h[7] << 24;
+			if (TRACE_BLOCK_HEADER + (size_t)bytes > STREAM_RAW_SIZE || count > STREAM_CHUNK_SIZE) {
+				corrupt = 1;
+				break;
+			}
+			if (s->raw_len - used - TRACE_BLOCK_HEADER < bytes) break;
+			// the rest goes in the next chunk
+			if (c->count + count > STREAM_CHUNK_SIZE) {
+				full = 1;
+				break;
+			}
+			long n = trace_decode_blocks(h, h + TRACE_BLOCK_HEADER + bytes, c->addrs + c->count);
+			if (n < 0) {
+				corrupt = 1;
+				break;
+			}
+			c->count += n;
+			used += TRACE_BLOCK_HEADER + bytes;
+		}
+		// once the input has ended, only a full chunk leaves whole blocks behind
+		if (corrupt || (s->eof && !full && used < s->raw_len)) {
+			fprintf(stderr, "corrupt compressed trace\n");
+			return -1;
+		}
+	} else if (s->format == STREAM_U32) {
+		c->count = s->raw_len / sizeof(uint32_t);
+		used = c->count * sizeof(uint32_t);
+		memcpy(c->addrs, s->raw, used);
+		// a partial address at the end of the file is ignored, as by trace_open
+		if (s->eof) used = s->raw_len;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		for (size_t i = 0; i < c->count; i++) c->addrs[i] = __builtin_bswap32(c->addrs[i]);
+#endif
+	} else {
+		// only whole lines, the rest waits for the next read
+		used = s->raw_len;
+		if (!s->eof) {
+			char *nl = memrchr(s->raw, '\n', s->raw_len);
+			if (nl) used = nl + 1 - s->raw;
+		}
+		const char *end = s->raw + used;
+		if (memchr(s->raw, 'W', used) || memchr(s->raw, 'R', used) || memchr(s->raw, 'w', used) || memchr(s->raw, 'r', used)) {
+			c->has_ops = 1;
+			c->count = trace_parse_ops(s->raw, end, c->addrs, c->ops, c->values);
+		} else {
+			c->count = trace_parse_text(s->raw, end, c->addrs);
+		}
+	}
+	memmove(s->raw, s->raw + used, s->raw_len - used);
+	s->raw_len -= used;
+	return 0;
+}
+
+static void *parser(void *arg)
+{
+	struct trace_stream *s = arg;
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		while (s->full[s->next_fill] && !s->done) pthread_cond_wait(&s->cond, &s->lock);
+		int i = s->next_fill;
+		int stop = s->done;
+		pthread_mutex_unlock(&s->lock);
+		if (stop) break;
+
+		int failed = parse_chunk(s, &s->chunks[i]);
+		// chunks without addresses (blank text) are skipped unless the input has ended
+		while (!failed && s->chunks[i].count == 0 && !s->eof) failed = parse_chunk(s, &s->chunks[i]);
+
+		pthread_mutex_lock(&s->lock);
+		if (failed) s->error = 1;
+		if (s->chunks[i].count > 0) {
+			s->full[i] = 1;
+			s->next_fill = !i;
+		}
+		if (failed || (s->eof && s->raw_len == 0)) s->done = 1;
+		pthread_cond_broadcast(&s->cond);
+		stop = s->done;
+		pthread_mutex_unlock(&s->lock);
+		if (stop) break;
+	}
+	return NULL;
+}
+
+int trace_stream_open(struct trace_stream *s, const char *path)
+{
+	memset(s, 0, sizeof(*s));
+	s->format = -1;
+	s->held = -1;
+	s->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+	if (s->fd < 0) {
+		perror(path);
+		return -1;
+	}
+	s->raw = malloc(STREAM_RAW_SIZE);
+	int failed = s->raw == NULL;
+	for (int i = 0; i < 2; i++) {
+		s->chunks[i].addrs = malloc(STREAM_CHUNK_SIZE * sizeof(uint32_t));
+		s->chunks[i].ops = malloc(STREAM_CHUNK_SIZE);
+		s->chunks[i].values = malloc(STREAM_CHUNK_SIZE);
+		failed |= !s->chunks[i].addrs || !s->chunks[i].ops || !s->chunks[i].values;
+	}
+	if (failed) {
+		perror("malloc");
+		exit(1);
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if (pthread_create(&s->thread, NULL, parser, s) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+	return 0;
+}
+
+const struct trace_chunk *trace_stream_next(struct trace_stream *s)
+{
+	pthread_mutex_lock(&s->lock);
+	if (s->held != -1) {
+		s->full[s->held] = 0;
+		s->held = -1;
+		pthread_cond_broadcast(&s->cond);
+	}
+	while (!s->full[s->next_read] && !s->done) pthread_cond_wait(&s->cond, &s->lock);
+	const struct trace_chunk *c = NULL;
+	if (s->full[s->next_read]) {
+		s->held = s->next_read;
+		s->next_read = !s->next_read;
+		c = &s->chunks[s->held];
+	}
+	pthread_mutex_unlock(&s->lock);
+	return c;
+}
+
+void trace_stream_close(struct trace_stream *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->done = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	if (s->fd != STDIN_FILENO) close(s->fd);
+	free(s->raw);
+	for (int i = 0; i < 2; i++) {
+		free(s->chunks[i].addrs);
+		free(s->chunks[i].ops);
+		free(s->chunks[i].values);
+	}
+	memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,67 @@
+/**
+ * stream.h
+ *
+ * Streaming trace reader for inputs too large to load, including stdin and pipes.
+ * A parser thread reads and parses the input into one of two fixed size chunks while
+ * the caller translates the other, so memory use does not depend on the trace length.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Bytes read from the input per chunk.
+#define STREAM_RAW_SIZE (1 << 20)
+// A chunk holds the addresses of one read, at most one per two bytes of text.
+#define STREAM_CHUNK_SIZE (STREAM_RAW_SIZE / 2 + 1)
+
+enum stream_format {
+	STREAM_TEXT,
+	STREAM_U32,	// TRACE_MAGIC binary trace
+	STREAM_VARINT	// TRACE_VARINT_MAGIC compressed trace
+};
+
+struct trace_chunk {
+	uint32_t *addrs;
+	// TRACE_READ / TRACE_WRITE and written values, filled when the text had R/W markers
+	uint8_t *ops;
+	int8_t *values;
+	int has_ops;
+	size_t count;
+};
+
+struct trace_stream {
+	int fd;
+	// parser thread state: input bytes not parsed yet, enum stream_format once known (-1 before the first read)
+	char *raw;
+	size_t raw_len;
+	int format;
+	int eof;
+	// chunks[i] is full when it holds addresses the caller has not released
+	struct trace_chunk chunks[2];
+	int full[2];
+	int next_fill;
+	int next_read;
+	// the caller is translating chunks[held], -1 if none
+	int held;
+	int done;
+	int error;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* Opens path ("-" for stdin) and starts the parser thread. Returns 0 on success, -1 on error. */
+int trace_stream_open(struct trace_stream *s, const char *path);
+
+/* Releases the chunk returned by the previous call and returns the next one, waiting for the
+ * parser if needed. Returns NULL at the end of the input or on a read error (s->error is then set). */
+const struct trace_chunk *trace_stream_next(struct trace_stream *s);
+
+/* Stops the parser thread and frees the buffers. */
+void trace_stream_close(struct trace_stream *s);
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * sweep.c
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sweep.h"
+
+struct sweep_job {
+	struct sweep_result *results;
+	int n;
+	// index of the next configuration to take
+	int next;
+	const uint32_t *addrs;
+	size_t count;
+	const struct backing_store *store;
+};
+
+static void *sweep_worker(void *arg)
+{
+	struct sweep_job *job = arg;
+	for (;;) {
+		int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if (i >= job->n) break;
+		struct sweep_result *r = &job->results[i];
+		struct vm vm;
+		if (vm_init(&vm, &r->config, job->store) < 0) {
+			r->invalid = 1;
+			continue;
+		}
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		vm_run(&vm, job->addrs, job->count);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		r->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+		r->stats = vm.stats;
+		vm_free(&vm);
+	}
+	return NULL;
+}
+
+void sweep_run(struct sweep_result *results, int n, const uint32_t *addrs, size_t count,
+	const struct backing_store *store, int threads)
+{
+	struct sweep_job job = {results, n, 0, addrs, count, store};
+	if (threads > n) threads = n;
+	if (threads < 1) threads = 1;
+
+	pthread_t *workers = malloc(threads * sizeof(pthread_t));
+	int started = 0;
+	for (int i = 0; i < threads; i++) {
+		if (pthread_create(&workers[i], NULL, sweep_worker, &job) != 0) break;
+		started++;
+	}
+	// without any thread the configurations still get run here
+	if (started == 0) sweep_worker(&job);
+	for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+	free(workers);
+}
+
+void sweep_print(FILE *fp, const struct sweep_result *results, int n)
+{
+	fprintf(fp, "%8s %8s %-13s %12s %8s %12s %8s %10s\n", "TLB", "Frames", "Policy",
+		"Page Faults", "PF Rate", "TLB Hits", "TLB Rate", "Mtrans/s");
+	for (int i = 0; i < n; i++) {
+		const struct sweep_result *r = &results[i];
+		const char *policy = replace_policy_names[r->config.policy];
+		if (r->invalid) {
+			fprintf(fp, "%8d %8d %-13s invalid configuration\n", r->config.tlb_size, r->config.frames, policy);
+			continue;
+		}
+		double total = r->stats.total_addresses ? r->stats.total_addresses : 1;
+		fprintf(fp, "%8d %8d %-13s %12llu %8.3f %12llu %8.3f %10.2f\n", r->config.tlb_size, r->config.frames, policy,
+			(unsigned long long)r->stats.page_faults, r->stats.page_faults / total,
+			(unsigned long long)r->stats.tlb_hits, r->stats.tlb_hits / total,
+			r->seconds > 0 ? r->stats.total_addresses / r->seconds * 1e-6 : 0.);
+	}
+}
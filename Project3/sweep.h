@@ -0,0 +1,33 @@
+/**
+ * sweep.h
+ *
+ * Runs many simulator configurations over one trace on a pool of threads.
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+struct sweep_result {
+	struct vm_config config;
+	struct vm_stats stats;
+	// set when the configuration was rejected by vm_init
+	int invalid;
+	// wall time of the translation loop
+	double seconds;
+};
+
+/* Simulates every results[i].config over the trace with up to threads workers.
+ * The trace and backing store are shared read-only; each configuration gets its own vm. */
+void sweep_run(struct sweep_result *results, int n, const uint32_t *addrs, size_t count,
+	const struct backing_store *store, int threads);
+
+/* Prints one row per configuration. */
+void sweep_print(FILE *fp, const struct sweep_result *results, int n);
+
+#endif
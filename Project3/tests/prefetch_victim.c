@@ -0,0 +1,101 @@
+/**
+ * prefetch_victim.c
+ *
+ * Read-ahead must never evict the page whose fault started it, nor give one frame to two of its
+ * pages. Runs strided faults mixed with hot pages under every policy, and checks after every
+ * translation that the frame returned holds the page translated and that the byte read is the
+ * one the same run without read-ahead reads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../vm.h"
+
+#define COUNT 20000
+#define OFFSET 8
+#define BITS 16
+
+static uint32_t addrs[COUNT];
+static signed char expected[COUNT];
+
+/* Translates the trace and returns the translations that went wrong, filling expected instead
+ * when prefetch is 0. Sets *prefetches to the pages read ahead. */
+static int run(const struct backing_store *store, enum replace_policy policy, int frames, int prefetch,
+	const uint64_t *next_use, uint64_t *prefetches)
+{
+	struct vm_config config = {OFFSET, BITS, BITS, frames, policy, 16, 0, TLB_FIFO, 1, 1, 1, prefetch, 0, 0};
+	config.next_use = next_use;
+	struct vm vm;
+	if (vm_init(&vm, &config, store) < 0) {
+		fprintf(stderr, "vm_init failed\n");
+		exit(1);
+	}
+	int wrong = 0;
+	for (size_t k = 0; k < COUNT; k++) {
+		unsigned flags = 0;
+		uint32_t physical_address = vm_translate(&vm, addrs[k], &flags);
+		signed char value = vm_load(&vm, physical_address);
+		if (prefetch == 0) expected[k] = value;
+		else if (vm.frame_owner[physical_address >> OFFSET] != (int)(addrs[k] >> OFFSET) || value != expected[k]) wrong++;
+	}
+	*prefetches = vm.stats.prefetches;
+	vm_free(&vm);
+	return wrong;
+}
+
+int main()
+{
+	char path[] = "/tmp/prefetch_victimXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	static signed char bytes[1 << BITS];
+	for (size_t i = 0; i < sizeof(bytes); i++) bytes[i] = i * 7;
+	if (write(fd, bytes, sizeof(bytes)) != sizeof(bytes)) {
+		perror("write");
+		return 1;
+	}
+	close(fd);
+	struct backing_store store;
+	if (backing_open(&store, path, 0) < 0) return 1;
+	unlink(path);
+
+	// runs of consecutive pages, so the stride detector reads ahead, between references to a few hot pages
+	uint32_t seed = 1;
+	for (size_t k = 0; k < COUNT; k++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t page = k % 4 == 3 ? (seed >> 16) % 4 : (k / 4 * 3 + k % 4) % (1u << (BITS - OFFSET));
+		addrs[k] = page << OFFSET | (seed >> 8) % (1u << OFFSET);
+	}
+	uint64_t *next_use = replace_next_use(addrs, COUNT, OFFSET, 1u << (BITS - OFFSET));
+
+	int frames[] = {4, 8, 16};
+	int prefetch[] = {2, 3};
+	int failures = 0;
+	for (int policy = 0; policy < REPLACE_POLICIES; policy++) {
+		for (int f = 0; f < 3; f++) {
+			uint64_t prefetches;
+			run(&store, policy, frames[f], 0, next_use, &prefetches);
+			for (int k = 0; k < 2; k++) {
+				int wrong = run(&store, policy, frames[f], prefetch[k], next_use, &prefetches);
+				if (wrong) {
+					printf("FAIL %s, %d frames, %d read ahead: %d translations to the wrong page\n",
+						replace_policy_names[policy], frames[f], prefetch[k], wrong);
+					failures++;
+				}
+				if (prefetches == 0) {
+					printf("FAIL %s, %d frames, %d read ahead: no read-ahead\n", replace_policy_names[policy], frames[f], prefetch[k]);
+					failures++;
+				}
+			}
+		}
+	}
+	free(next_use);
+	backing_close(&store);
+	if (failures == 0) printf("prefetch_victim: ok\n");
+	return failures != 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * stream_varint.c
+ *
+ * A compressed trace longer than one stream chunk leaves whole blocks behind every time a chunk
+ * fills up, including after the parser has read to the end of the file. Streams such a trace and
+ * checks that it gives the same addresses as loading the file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../trace.h"
+#include "../stream.h"
+
+// three chunks and a part of a block
+#define COUNT (3 * STREAM_CHUNK_SIZE + 1000)
+
+static uint32_t addrs[COUNT];
+
+int main()
+{
+	char path[] = "/tmp/stream_varintXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	// steps of one, a byte each, with a jump to a random address every 64 addresses
+	uint32_t seed = 1, address = 0;
+	for (size_t k = 0; k < COUNT; k++) {
+		seed = seed * 1103515245 + 12345;
+		address = k % 64 == 63 ? seed >> 8 : address + 1;
+		addrs[k] = address;
+	}
+	if (trace_write_varint(path, addrs, COUNT) < 0) return 1;
+
+	struct trace t;
+	if (trace_open(&t, path) < 0) return 1;
+	struct trace_stream s;
+	if (trace_stream_open(&s, path) < 0) return 1;
+	unlink(path);
+
+	size_t count = 0, wrong = 0;
+	const struct trace_chunk *c;
+	while ((c = trace_stream_next(&s))) {
+		for (size_t i = 0; i < c->count; i++, count++) {
+			if (count >= t.count || c->addrs[i] != t.addrs[count]) wrong++;
+		}
+	}
+	int failed = s.error || count != t.count || wrong;
+	if (failed) fprintf(stderr, "FAIL streamed %zu of %zu addresses, %zu wrong%s\n", count, t.count, wrong, s.error ? ", read error" : "");
+	trace_stream_close(&s);
+	trace_close(&t);
+	if (failed) return 1;
+	printf("stream_varint: ok\n");
+	return 0;
+}
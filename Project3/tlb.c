@@ -0,0 +1,134 @@
+/**
+ * tlb.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlb.h"
+
+int tlb_parse_policy(const char *name)
+{
+	if (strcmp(name, "fifo") == 0) return TLB_FIFO;
+	if (strcmp(name, "lru") == 0) return TLB_LRU;
+	if (strcmp(name, "plru") == 0) return TLB_PLRU;
+	if (strcmp(name, "random") == 0) return TLB_RANDOM;
+	return -1;
+}
+
+int tlb_init(struct tlb *t, int size, int ways, enum tlb_policy policy)
+{
+	memset(t, 0, sizeof(*t));
+	if (size <= 0 || ways < 0) return -1;
+	if (ways == 0) ways = size;
+	if (size % ways != 0) return -1;
+	int sets = size / ways;
+	if (sets & (sets - 1)) return -1;
+	if (policy == TLB_PLRU && (ways & (ways - 1))) return -1;
+
+	t->size = size;
+	t->ways = ways;
+	t->sets = sets;
+	while ((1 << t->set_bits) < sets) t->set_bits++;
+	t->policy = policy;
+	t->asid = calloc(size, sizeof(int32_t));
+	t->logical = calloc(size, sizeof(int32_t));
+	t->physical = calloc(size, sizeof(int32_t));
+	t->valid = calloc(size, sizeof(int32_t));
+	t->stamp = calloc(size, sizeof(uint64_t));
+	t->plru = calloc(size, sizeof(uint8_t));
+	t->fifo = calloc(sets, sizeof(int));
+	t->rng = 0x2545f4914f6cdd1dull;
+	if (!t->asid || !t->logical || !t->physical || !t->valid || !t->stamp || !t->plru || !t->fifo) {
+		perror("calloc");
+		exit(1);
+	}
+	return 0;
+}
+
+void tlb_free(struct tlb *t)
+{
+	free(t->asid);
+	free(t->logical);
+	free(t->physical);
+	free(t->valid);
+	free(t->stamp);
+	free(t->plru);
+	free(t->fifo);
+	memset(t, 0, sizeof(*t));
+}
+
+/* Updates the replacement state after a use of the given way. */
+void tlb_touch(struct tlb *t, int set, int way)
+{
+	if (t->policy == TLB_LRU) {
+		t->stamp[set * t->ways + way] = ++t->clock;
+	} else if (t->policy == TLB_PLRU) {
+		// tree nodes 1 .. ways - 1, each bit points to the half holding the victim
+		uint8_t *bits = t->plru + set * t->ways;
+		int node = 1;
+		for (int half = t->ways >> 1; half > 0; half >>= 1) {
+			int right = (way & half) != 0;
+			bits[node] = !right;
+			node = 2 * node + right;
+		}
+	}
+}
+
+static int tlb_victim(struct tlb *t, int set)
+{
+	const int32_t *valid = t->valid + set * t->ways;
+	for (int i = 0; i < t->ways; i++) {
+		if (!valid[i]) return i;
+	}
+
+	switch (t->policy) {
+	case TLB_LRU: {
+		uint64_t *stamp = t->stamp + set * t->ways;
+		int victim = 0;
+		for (int i = 1; i < t->ways; i++) {
+			if (stamp[i] < stamp[victim]) victim = i;
+		}
+		return victim;
+	}
+	case TLB_PLRU: {
+		uint8_t *bits = t->plru + set * t->ways;
+		int node = 1;
+		while (node < t->ways) node = 2 * node + bits[node];
+		return node - t->ways;
+	}
+	case TLB_RANDOM:
+		// xorshift64
+		t->rng ^= t->rng << 13;
+		t->rng ^= t->rng >> 7;
+		t->rng ^= t->rng << 17;
+		return t->rng % t->ways;
+	default: {
+		int victim = t->fifo[set];
+		t->fifo[set] = (victim + 1) % t->ways;
+		return victim;
+	}
+	}
+}
+
+int tlb_slot(struct tlb *t, int asid, int logical)
+{
+	int set = tlb_set_index(t, asid, logical);
+	int way = tlb_victim(t, set);
+	tlb_touch(t, set, way);
+	return set * t->ways + way;
+}
+
+void tlb_insert(struct tlb *t, int asid, int logical, int physical)
+{
+	tlb_set(t, tlb_slot(t, asid, logical), asid, logical, physical);
+}
+
+void tlb_invalidate(struct tlb *t, int asid, int logical)
+{
+	int set = tlb_set_index(t, asid, logical);
+	// an insert only follows a failed lookup, so a mapping is in its set at most once
+	int way = tlb_find(t, set * t->ways, asid, logical);
+	if (way >= 0) t->valid[set * t->ways + way] = 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * tlb.h
+ *
+ * Set associative TLB with a configurable number of entries, ways and replacement policy.
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+enum tlb_policy {
+	TLB_FIFO,
+	TLB_LRU,	// true LRU, timestamp per entry
+	TLB_PLRU,	// tree pseudo-LRU, ways must be a power of two
+	TLB_RANDOM
+};
+
+// Set in the logical field of entries that map a whole superpage; the rest is the superpage number.
+#define TLB_SUPERPAGE (1 << 30)
+
+struct tlb {
+	int size;
+	int ways;
+	int sets;
+	int set_bits;
+	enum tlb_policy policy;
+	// entry i of set s is index s * ways + i in each array; kept as separate arrays so a lookup
+	// compares all the ways of a set with a few vector instructions
+	// address space the mapping belongs to, so entries of several processes can coexist
+	int32_t *asid;
+	int32_t *logical;
+	int32_t *physical;
+	// -1 (all bits set) for entries holding a mapping, 0 for empty ones, so it masks compare results directly
+	int32_t *valid;
+	// TLB_LRU: last use time of each entry
+	uint64_t *stamp;
+	uint64_t clock;
+	// TLB_FIFO: next way to replace in each set. TLB_PLRU: ways - 1 tree bits per set.
+	uint8_t *plru;
+	int *fifo;
+	uint64_t rng;
+};
+
+/* Returns the policy named by name ("fifo", "lru", "plru" or "random") or -1. */
+int tlb_parse_policy(const char *name);
+
+/* Sets up a TLB with size entries split into sets of the given number of ways.
+ * ways == 0 makes it fully associative. size / ways must be a power of two.
+ * Returns 0 on success, -1 if the geometry is invalid. */
+int tlb_init(struct tlb *t, int size, int ways, enum tlb_policy policy);
+
+void tlb_free(struct tlb *t);
+
+/* Picks the entry of the set of logical that an insert replaces (an empty one if there is one) and
+ * marks it used. Returns its index, so the caller can read the entry before overwriting it with tlb_set. */
+int tlb_slot(struct tlb *t, int asid, int logical);
+
+static inline void tlb_set(struct tlb *t, int i, int asid, int logical, int physical)
+{
+	t->asid[i] = asid;
+	t->logical[i] = logical;
+	t->physical[i] = physical;
+	t->valid[i] = -1;
+}
+
+/* Adds the specified mapping to the TLB, replacing an entry of its set chosen by the policy. */
+void tlb_insert(struct tlb *t, int asid, int logical, int physical);
+
+/* Drops the mapping for logical in address space asid if it is cached. */
+void tlb_invalidate(struct tlb *t, int asid, int logical);
+
+void tlb_touch(struct tlb *t, int set, int way);
+
+static inline int tlb_set_index(const struct tlb *t, int asid, int logical)
+{
+	if (t->set_bits == 0) return 0;
+	// multiplicative hash so that strided page numbers (and the same page in several address spaces) spread over the sets
+	return (((uint32_t)logical ^ ((uint32_t)asid << 24)) * 0x9e3779b1u) >> (32 - t->set_bits);
+}
+
+/* Returns the way of the set starting at index base that maps logical in address space asid, or -1. */
+static inline int tlb_find(const struct tlb *t, int base, int asid, int logical)
+{
+	const int32_t *a = t->asid + base, *l = t->logical + base, *v = t->valid + base;
+	int i = 0;
+#ifdef __AVX2__
+	__m256i asid8 = _mm256_set1_epi32(asid), logical8 = _mm256_set1_epi32(logical);
+	for (; i + 8 <= t->ways; i += 8) {
+		__m256i eq = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(l + i)), logical8),
+			_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(a + i)), asid8));
+		eq = _mm256_and_si256(eq, _mm256_loadu_si256((const __m256i *)(v + i)));
+		int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+#endif
+#ifdef __SSE2__
+	__m128i asid4 = _mm_set1_epi32(asid), logical4 = _mm_set1_epi32(logical);
+	for (; i + 4 <= t->ways; i += 4) {
+		__m128i eq = _mm_and_si128(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(l + i)), logical4),
+			_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i)), asid4));
+		eq = _mm_and_si128(eq, _mm_loadu_si128((const __m128i *)(v + i)));
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+#endif
+	// scalar loop for the ways left over, and for everything without SSE2
+	for (; i < t->ways; i++) {
+		if (v[i] && l[i] == logical && a[i] == asid) return i;
+	}
+	return -1;
+}
+
+/* Returns the physical page from TLB or -1 if not present. */
+static inline int tlb_lookup(struct tlb *t, int asid, int logical)
+{
+	int set = tlb_set_index(t, asid, logical);
+	int way = tlb_find(t, set * t->ways, asid, logical);
+	if (way < 0) return -1;
+	if (t->policy == TLB_LRU || t->policy == TLB_PLRU) tlb_touch(t, set, way);
+	return t->physical[set * t->ways + way];
+}
+
+#endif
@@ -0,0 +1,327 @@
+/**
+ * trace.c
+ *
+ * Address trace loading. Input files are memory mapped; text traces are parsed
+ * without per-line libc calls and binary traces are used without parsing at all.
+ */
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "trace.h"
+
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') <= 9)
+
+#ifdef __SSE4_1__
+/* Parses the run of digits starting at p, reading 16 bytes. Sets *len to the number of digits.
+ * Returns 0 with *len > 10 when the run is too long for this kernel. */
+static inline uint64_t parse_digits_sse(const char *p, int *len)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *)p);
+	__m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	// digit bytes are exactly those with (c - '0') <= 9 as unsigned
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	unsigned mask = ~_mm_movemask_epi8(is_digit) | 0x10000;
+	int n = __builtin_ctz(mask);
+	*len = n;
+	if (n > 10) return 0;
+
+	// Move the n digits to the top of the register with zeros in front of them.
+	// Shuffle indices below zero have the high bit set, which makes pshufb write a zero.
+	__m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i idx = _mm_add_epi8(iota, _mm_set1_epi8((char)(n - 16)));
+	d = _mm_shuffle_epi8(d, idx);
+
+	// 16 digits -> 8 two digit -> 4 four digit -> 2 eight digit numbers
+	d = _mm_maddubs_epi16(d, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+	d = _mm_madd_epi16(d, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+	d = _mm_packus_epi32(d, d);
+	d = _mm_madd_epi16(d, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+	uint64_t hi = (uint32_t)_mm_cvtsi128_si32(d);
+	uint64_t lo = (uint32_t)_mm_extract_epi32(d, 1);
+	return hi * 100000000 + lo;
+}
+#endif
+
+size_t trace_parse_text(const char *p, const char *end, uint32_t *out)
+{
+	size_t n = 0;
+	while (p < end) {
+		if (!IS_DIGIT(*p)) {
+			p++;
+			continue;
+		}
+#ifdef __SSE4_1__
+		if (end - p >= 16) {
+			int len;
+			uint64_t value = parse_digits_sse(p, &len);
+			if (len <= 10) {
+				out[n++] = (uint32_t)value;
+				p += len;
+				continue;
+			}
+		}
+#endif
+		uint32_t value = 0;
+		while (p < end && IS_DIGIT(*p)) value = value * 10 + (*p++ - '0');
+		out[n++] = value;
+	}
+	return n;
+}
+
+size_t trace_parse_ops(const char *p, const char *end, uint32_t *out, uint8_t *ops, int8_t *values)
+{
+	size_t n = 0;
+	while (p < end) {
+		// one line: optional R/W marker, address, value for writes
+		uint8_t op = TRACE_READ;
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+		if (p == end) break;
+		if (*p == 'W' || *p == 'w') op = TRACE_WRITE;
+		if (!IS_DIGIT(*p)) p++;
+		while (p < end && (*p == ' ' || *p == '\t')) p++;
+		if (p == end || !IS_DIGIT(*p)) {
+			// not an address, skip the rest of the line
+			while (p < end && *p != '\n') p++;
+			continue;
+		}
+		uint32_t address = 0;
+		while (p < end && IS_DIGIT(*p)) address = address * 10 + (*p++ - '0');
+		int value = 0;
+		if (op == TRACE_WRITE) {
+			while (p < end && (*p == ' ' || *p == '\t')) p++;
+			int negative = p < end && *p == '-';
+			if (negative) p++;
+			while (p < end && IS_DIGIT(*p)) value = value * 10 + (*p++ - '0');
+			if (negative) value = -value;
+		}
+		out[n] = address;
+		ops[n] = op;
+		values[n] = (int8_t)value;
+		n++;
+		while (p < end && *p != '\n') p++;
+	}
+	return n;
+}
+
+static uint32_t read_u32le(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+long trace_count_blocks(const uint8_t *p, const uint8_t *end)
+{
+	long total = 0;
+	while (p < end) {
+		if (end - p < TRACE_BLOCK_HEADER) return -1;
+		uint32_t count = read_u32le(p), bytes = read_u32le(p + 4);
+		if (count > TRACE_BLOCK_SIZE || bytes > (size_t)(end - p) - TRACE_BLOCK_HEADER) return -1;
+		total += count;
+		p += TRACE_BLOCK_HEADER + bytes;
+	}
+	return total;
+}
+
+long trace_decode_blocks(const uint8_t *p, const uint8_t *end, uint32_t *out)
+{
+	long n = 0;
+	while (p < end) {
+		if (end - p < TRACE_BLOCK_HEADER) return -1;
+		uint32_t count = read_u32le(p), bytes = read_u32le(p + 4);
+		p += TRACE_BLOCK_HEADER;
+		if (count > TRACE_BLOCK_SIZE || bytes > (size_t)(end - p)) return -1;
+		const uint8_t *block_end = p + bytes;
+		uint32_t address = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t v = 0;
+			int shift = 0;
+			// 7 bits per byte, high bit set on all but the last byte
+			do {
+				if (p == block_end || shift > 28) return -1;
+				v |= (uint32_t)(*p & 0x7f) << shift;
+				shift += 7;
+			} while (*p++ & 0x80);
+			// zig-zag: even values are non-negative differences, odd ones negative
+			address += (v >> 1) ^ -(v & 1);
+			out[n++] = address;
+		}
+		if (p != block_end) return -1;
+	}
+	return n;
+}
+
+/* Returns 1 if the text has R/W markers. */
+static int has_ops(const char *p, size_t len)
+{
+	return memchr(p, 'W', len) || memchr(p, 'R', len) || memchr(p, 'w', len) || memchr(p, 'r', len);
+}
+
+int trace_open(struct trace *t, const char *path)
+{
+	memset(t, 0, sizeof(*t));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	t->map_len = st.st_size;
+	t->map = mmap(0, t->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (t->map == MAP_FAILED) {
+		perror(path);
+		t->map = NULL;
+		return -1;
+	}
+	madvise(t->map, t->map_len, MADV_SEQUENTIAL);
+
+	const char *data = t->map;
+	if (t->map_len >= TRACE_MAGIC_LEN && memcmp(data, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		t->count = (t->map_len - TRACE_MAGIC_LEN) / sizeof(uint32_t);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		t->owned = malloc(t->count * sizeof(uint32_t) + 1);
+		for (size_t i = 0; i < t->count; i++) {
+			uint32_t v;
+			memcpy(&v, data + TRACE_MAGIC_LEN + i * sizeof(v), sizeof(v));
+			t->owned[i] = __builtin_bswap32(v);
+		}
+		t->addrs = t->owned;
+#else
+		t->addrs = (const uint32_t *)(data + TRACE_MAGIC_LEN);
+#endif
+		return 0;
+	}
+
+	if (t->map_len >= TRACE_MAGIC_LEN && memcmp(data, TRACE_VARINT_MAGIC, TRACE_MAGIC_LEN) == 0) {
+		const uint8_t *p = (const uint8_t *)data + TRACE_MAGIC_LEN, *end = (const uint8_t *)data + t->map_len;
+		long count = trace_count_blocks(p, end);
+		t->owned = count < 0 ? NULL : malloc(count * sizeof(uint32_t) + 1);
+		if (count < 0 || t->owned == NULL || trace_decode_blocks(p, end, t->owned) != count) {
+			fprintf(stderr, "%s: corrupt compressed trace\n", path);
+			trace_close(t);
+			return -1;
+		}
+		munmap(t->map, t->map_len);
+		t->map = NULL;
+		t->addrs = t->owned;
+		t->count = count;
+		return 0;
+	}
+
+	t->owned = malloc((t->map_len / 2 + 1) * sizeof(uint32_t));
+	if (t->owned == NULL) {
+		perror("malloc");
+		trace_close(t);
+		return -1;
+	}
+	if (has_ops(data, t->map_len)) {
+		size_t max = t->map_len / 2 + 1;
+		t->ops = malloc(max);
+		t->values = malloc(max);
+		if (t->ops == NULL || t->values == NULL) {
+			perror("malloc");
+			trace_close(t);
+			return -1;
+		}
+		t->count = trace_parse_ops(data, data + t->map_len, t->owned, t->ops, t->values);
+	} else {
+		t->count = trace_parse_text(data, data + t->map_len, t->owned);
+	}
+	// text is not needed anymore once parsed
+	munmap(t->map, t->map_len);
+	t->map = NULL;
+	t->addrs = t->owned;
+	return 0;
+}
+
+void trace_close(struct trace *t)
+{
+	if (t->map) munmap(t->map, t->map_len);
+	free(t->owned);
+	free(t->ops);
+	free(t->values);
+	memset(t, 0, sizeof(*t));
+}
+
+int trace_write_u32(const char *path, const uint32_t *addrs, size_t n)
+{
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+	fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, fp);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for (size_t i = 0; i < n; i++) {
+		uint32_t v = __builtin_bswap32(addrs[i]);
+		fwrite(&v, sizeof(v), 1, fp);
+	}
+#else
+	fwrite(addrs, sizeof(uint32_t), n, fp);
+#endif
+	if (fclose(fp) != 0) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+int trace_write_varint(const char *path, const uint32_t *addrs, size_t n)
+{
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL) {
+		perror(path);
+		return -1;
+	}
+	fwrite(TRACE_VARINT_MAGIC, 1, TRACE_MAGIC_LEN, fp);
+	uint8_t *block = malloc(TRACE_BLOCK_HEADER + TRACE_BLOCK_SIZE * TRACE_VARINT_MAX);
+	if (block == NULL) {
+		perror("malloc");
+		fclose(fp);
+		return -1;
+	}
+	for (size_t start = 0; start < n; start += TRACE_BLOCK_SIZE) {
+		size_t count = n - start < TRACE_BLOCK_SIZE ? n - start : TRACE_BLOCK_SIZE;
+		uint8_t *p = block + TRACE_BLOCK_HEADER;
+		uint32_t previous = 0;
+		for (size_t i = start; i < start + count; i++) {
+			int32_t delta = (int32_t)(addrs[i] - previous);
+			uint32_t v = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+			previous = addrs[i];
+			while (v >= 0x80) {
+				*p++ = v | 0x80;
+				v >>= 7;
+			}
+			*p++ = v;
+		}
+		uint32_t header[2] = {count, (uint32_t)(p - block - TRACE_BLOCK_HEADER)};
+		for (int k = 0; k < 8; k++) block[k] = header[k / 4] >> (k % 4 * 8);
+		fwrite(block, 1, p - block, fp);
+	}
+	free(block);
+	if (fclose(fp) != 0) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * trace.h
+ *
+ * Address trace loading for the virtual memory simulators.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// trace.ops values
+#define TRACE_READ 0
+#define TRACE_WRITE 1
+
+// First 8 bytes of a binary trace. The rest of the file is packed little-endian uint32 addresses.
+#define TRACE_MAGIC "VMTRU32\n"
+#define TRACE_MAGIC_LEN 8
+
+// First 8 bytes of a compressed trace, followed by blocks of up to TRACE_BLOCK_SIZE addresses.
+// Each block is a little-endian uint32 address count and uint32 payload length in bytes, then the
+// payload: per address the zig-zag LEB128 varint of its difference from the previous address
+// (from 0 for the first of the block, so every block decodes on its own).
+#define TRACE_VARINT_MAGIC "VMTRVAR\n"
+#define TRACE_BLOCK_SIZE 65536
+#define TRACE_BLOCK_HEADER 8
+// longest varint of a 32 bit value
+#define TRACE_VARINT_MAX 5
+
+struct trace {
+	// addresses of the trace, in order
+	const uint32_t *addrs;
+	size_t count;
+	// memory mapped input file (NULL for an empty file)
+	void *map;
+	size_t map_len;
+	// parsed addresses for text traces, NULL when addrs points into map
+	uint32_t *owned;
+	// TRACE_READ or TRACE_WRITE per address and the byte each write stores.
+	// NULL for traces without "R"/"W" markers, which only read.
+	uint8_t *ops;
+	int8_t *values;
+};
+
+/* Maps the file at path and fills t. Binary traces are used in place, compressed traces are decoded, text traces
+ * (one decimal address per line) are parsed in bulk. Text traces may also have lines
+ * "R address" and "W address value", which fill ops and values. Returns 0 on success, -1 on error. */
+int trace_open(struct trace *t, const char *path);
+
+/* Unmaps the file and frees parsed addresses. */
+void trace_close(struct trace *t);
+
+/* Parses decimal addresses in [p, end) into out, which must have room for (end - p) / 2 + 1
+ * entries. Returns the number of addresses parsed. */
+size_t trace_parse_text(const char *p, const char *end, uint32_t *out);
+
+/* Parses a text trace with R/W markers. ops and values need as much room as out. */
+size_t trace_parse_ops(const char *p, const char *end, uint32_t *out, uint8_t *ops, int8_t *values);
+
+/* Writes n addresses as a binary trace to path. Returns 0 on success, -1 on error. */
+int trace_write_u32(const char *path, const uint32_t *addrs, size_t n);
+
+/* Writes n addresses as a compressed trace to path. Returns 0 on success, -1 on error. */
+int trace_write_varint(const char *path, const uint32_t *addrs, size_t n);
+
+/* Decodes the compressed blocks in [p, end) into out, which must have room for all of them.
+ * Returns the number of addresses, or -1 if the data is corrupt or ends inside a block. */
+long trace_decode_blocks(const uint8_t *p, const uint8_t *end, uint32_t *out);
+
+/* Number of addresses in the compressed blocks in [p, end), from the block headers alone, or -1. */
+long trace_count_blocks(const uint8_t *p, const uint8_t *end);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * tracecvt.c
+ *
+ * Converts an address trace to the binary (-f u32, default) or compressed (-f varint)
+ * trace format read by part1 and part2.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+int main(int argc, const char *argv[])
+{
+	int varint = 0;
+	if (argc == 5 && strcmp(argv[3], "-f") == 0 && strcmp(argv[4], "varint") == 0) varint = 1;
+	else if (!(argc == 3 || (argc == 5 && strcmp(argv[3], "-f") == 0 && strcmp(argv[4], "u32") == 0))) {
+		fprintf(stderr, "Usage ./tracecvt input output [-f u32|varint]\n");
+		exit(1);
+	}
+
+	struct trace trace;
+	if (trace_open(&trace, argv[1]) < 0) exit(1);
+	if (trace.ops) {
+		fprintf(stderr, "%s has writes, which the binary format cannot hold\n", argv[1]);
+		exit(1);
+	}
+	if ((varint ? trace_write_varint(argv[2], trace.addrs, trace.count) : trace_write_u32(argv[2], trace.addrs, trace.count)) < 0) exit(1);
+	trace_close(&trace);
+
+	return 0;
+}
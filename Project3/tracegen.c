@@ -0,0 +1,167 @@
+/**
+ * tracegen.c
+ *
+ * Generates synthetic address traces with a chosen kind of locality, for benchmarking
+ * part1 and part2 on inputs larger than addresses.txt.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+#define COUNT 1000000
+#define ADDRESS_BITS 16
+#define PAGE_BITS 10
+#define WORKING_SET 64
+#define PHASES 4
+#define STRIDE 64
+
+enum distribution {
+	DIST_UNIFORM,	// every address equally likely
+	DIST_ZIPF,	// page ranks follow a Zipf law, hot pages scattered over the address space
+	DIST_SEQUENTIAL,	// scan through the address space with a fixed stride
+	DIST_LOOP,	// cycle through a working set of pages in order
+	DIST_PHASES	// uniform over a working set that moves to a new place every phase
+};
+
+static const char *distribution_names[] = {"uniform", "zipf", "seq", "loop", "phases"};
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static uint64_t next_random()
+{
+	// xorshift64*
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 0x2545f4914f6cdd1dull;
+}
+
+/* Uniform in [0, n). */
+static uint32_t random_below(uint64_t n)
+{
+	return (uint32_t)((next_random() >> 32) * n >> 32);
+}
+
+void usage()
+{
+	fprintf(stderr, "Usage ./tracegen output [-d uniform|zipf|seq|loop|phases] [-n count] [-v address_bits] [-s page_size] [-w working_set_pages] [-a zipf_exponent] [-p phases] [-r seed] [-f text|binary]\n");
+	exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2 || argc % 2 != 0) usage();
+	int dist = DIST_UNIFORM;
+	long count = COUNT;
+	int address_bits = ADDRESS_BITS, page_bits = PAGE_BITS;
+	long working_set = WORKING_SET;
+	int phases = PHASES;
+	double alpha = 1.0;
+	int text = 0;
+	for (int i = 2; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-d") == 0) {
+			dist = -1;
+			for (int d = 0; d <= DIST_PHASES; d++) {
+				if (strcmp(argv[i+1], distribution_names[d]) == 0) dist = d;
+			}
+		}
+		else if (strcmp(argv[i], "-n") == 0) count = atol(argv[i+1]);
+		else if (strcmp(argv[i], "-v") == 0) address_bits = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-s") == 0) {
+			int size = atoi(argv[i+1]);
+			page_bits = size > 1 && (size & (size - 1)) == 0 ? __builtin_ctz(size) : -1;
+		}
+		else if (strcmp(argv[i], "-w") == 0) working_set = atol(argv[i+1]);
+		else if (strcmp(argv[i], "-a") == 0) alpha = atof(argv[i+1]);
+		else if (strcmp(argv[i], "-p") == 0) phases = atoi(argv[i+1]);
+		else if (strcmp(argv[i], "-r") == 0) rng = strtoull(argv[i+1], NULL, 10) * 0x9e3779b97f4a7c15ull | 1;
+		else if (strcmp(argv[i], "-f") == 0 && strcmp(argv[i+1], "text") == 0) text = 1;
+		else if (strcmp(argv[i], "-f") == 0 && strcmp(argv[i+1], "binary") == 0) text = 0;
+		else usage();
+	}
+	if (dist < 0 || count < 0 || address_bits < 1 || address_bits > 32 || page_bits < 1 || page_bits >= address_bits || phases < 1 || alpha <= 0) usage();
+	uint64_t pages = 1ull << (address_bits - page_bits);
+	uint32_t page_size = 1u << page_bits;
+	if (working_set < 1 || (uint64_t)working_set > pages) usage();
+
+	uint32_t *addrs = malloc(count * sizeof(uint32_t) + 1);
+	if (addrs == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	// Zipf: cdf[r] is the probability of the r + 1 hottest pages, rank r is page (r * step) mod pages
+	// with an odd step, so the hot pages are spread out
+	double *cdf = NULL;
+	uint64_t step = (random_below(pages) | 1) % pages;
+	if (dist == DIST_ZIPF) {
+		cdf = malloc(pages * sizeof(double));
+		if (cdf == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		double sum = 0;
+		for (uint64_t r = 0; r < pages; r++) cdf[r] = sum += pow(r + 1, -alpha);
+		for (uint64_t r = 0; r < pages; r++) cdf[r] /= sum;
+	}
+
+	uint64_t base = 0;
+	long phase_length = (count + phases - 1) / phases;
+	for (long k = 0; k < count; k++) {
+		uint64_t page;
+		uint32_t offset = random_below(page_size);
+		switch (dist) {
+		case DIST_ZIPF: {
+			double u = (next_random() >> 11) * (1.0 / (1ull << 53));
+			uint64_t lo = 0, hi = pages - 1;
+			while (lo < hi) {
+				uint64_t mid = (lo + hi) / 2;
+				if (cdf[mid] < u) lo = mid + 1; else hi = mid;
+			}
+			page = lo * step % pages;
+			break;
+		}
+		case DIST_SEQUENTIAL: {
+			uint64_t address = (uint64_t)k * STRIDE % (pages * page_size);
+			page = address >> page_bits;
+			offset = address & (page_size - 1);
+			break;
+		}
+		case DIST_LOOP:
+			page = k % working_set;
+			break;
+		case DIST_PHASES:
+			if (k % phase_length == 0) base = random_below(pages - working_set + 1);
+			page = base + random_below(working_set);
+			break;
+		default:
+			page = random_below(pages);
+			break;
+		}
+		addrs[k] = (uint32_t)(page << page_bits | offset);
+	}
+
+	const char *output_filename = argv[1];
+	if (text) {
+		FILE *fp = fopen(output_filename, "w");
+		if (fp == NULL) {
+			perror(output_filename);
+			exit(1);
+		}
+		for (long k = 0; k < count; k++) fprintf(fp, "%u\n", addrs[k]);
+		if (fclose(fp) != 0) {
+			perror(output_filename);
+			exit(1);
+		}
+	} else if (trace_write_u32(output_filename, addrs, count) < 0) {
+		exit(1);
+	}
+
+	free(cdf);
+	free(addrs);
+	return 0;
+}
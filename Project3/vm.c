@@ -0,0 +1,678 @@
+/**
+ * vm.c
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "vm.h"
+
+// Translation loops with the page size fixed at compile time for the common sizes.
+#define RUN_KERNEL(bits) \
+static void vm_run_##bits(struct vm *vm, const uint32_t *addrs, size_t n) \
+{ \
+	unsigned flags = 0; \
+	for (size_t k = 0; k < n; k++) vm_translate_bits(vm, addrs[k], &flags, bits); \
+} \
+static void vm_batch_##bits(struct vm *vm, const uint32_t *addrs, size_t n, uint32_t *out_phys, int8_t *out_vals) \
+{ \
+	unsigned flags = 0; \
+	for (size_t k = 0; k < n; k++) { \
+		uint32_t physical_address = vm_translate_bits(vm, addrs[k], &flags, bits); \
+		out_phys[k] = physical_address; \
+		if (out_vals) out_vals[k] = vm->frame_data[physical_address >> bits][physical_address & ((1u << bits) - 1)]; \
+	} \
+}
+
+RUN_KERNEL(10)	// 1 KiB
+RUN_KERNEL(12)	// 4 KiB
+RUN_KERNEL(16)	// 64 KiB
+RUN_KERNEL(21)	// 2 MiB
+
+static void vm_run_generic(struct vm *vm, const uint32_t *addrs, size_t n)
+{
+	unsigned flags = 0;
+	for (size_t k = 0; k < n; k++) vm_translate(vm, addrs[k], &flags);
+}
+
+static void vm_batch_generic(struct vm *vm, const uint32_t *addrs, size_t n, uint32_t *out_phys, int8_t *out_vals)
+{
+	unsigned flags = 0;
+	for (size_t k = 0; k < n; k++) {
+		out_phys[k] = vm_translate(vm, addrs[k], &flags);
+		if (out_vals) out_vals[k] = vm_load(vm, out_phys[k]);
+	}
+}
+
+static vm_run_fn vm_run_kernel(int offset_bits)
+{
+	switch (offset_bits) {
+	case 10: return vm_run_10;
+	case 12: return vm_run_12;
+	case 16: return vm_run_16;
+	case 21: return vm_run_21;
+	default: return vm_run_generic;
+	}
+}
+
+static vm_batch_fn vm_batch_kernel(int offset_bits)
+{
+	switch (offset_bits) {
+	case 10: return vm_batch_10;
+	case 12: return vm_batch_12;
+	case 16: return vm_batch_16;
+	case 21: return vm_batch_21;
+	default: return vm_batch_generic;
+	}
+}
+
+int backing_open(struct backing_store *store, const char *path, int write_back)
+{
+	memset(store, 0, sizeof(*store));
+	store->fd = -1;
+	store->write_back = write_back;
+	int fd = open(path, write_back ? O_RDWR : O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	store->size = st.st_size;
+	if (store->size > 0) {
+		// a shared mapping sees the pages written back with pwritev
+		if (write_back) store->data = mmap(0, store->size, PROT_READ, MAP_SHARED, fd, 0);
+		else store->data = mmap(0, store->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (store->data == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			store->data = NULL;
+			return -1;
+		}
+	}
+	store->fd = fd;
+	return 0;
+}
+
+void backing_close(struct backing_store *store)
+{
+	if (store->data) munmap(store->data, store->size);
+	if (store->fd >= 0) close(store->fd);
+	memset(store, 0, sizeof(*store));
+}
+
+int vm_parse_page_size(const char *s)
+{
+	char *end;
+	unsigned long long size = strtoull(s, &end, 10);
+	if (*end == 'K' || *end == 'k') size <<= 10, end++;
+	else if (*end == 'M' || *end == 'm') size <<= 20, end++;
+	if (*end != '\0' || size < 2 || (size & (size - 1))) return -1;
+	return __builtin_ctzll(size);
+}
+
+int vm_parse_superpage(const char *s)
+{
+	char *end;
+	unsigned long long pages = strtoull(s, &end, 10);
+	if (end == s || *end != '\0' || (pages & (pages - 1))) return -1;
+	return pages > 1 ? __builtin_ctzll(pages) : 0;
+}
+
+int vm_init(struct vm *vm, const struct vm_config *config, const struct backing_store *store)
+{
+	memset(vm, 0, sizeof(*vm));
+	if (config->offset_bits < 1 || config->virtual_bits > 32 || config->physical_bits > 32) return -1;
+	if (config->offset_bits >= config->virtual_bits || config->offset_bits >= config->physical_bits) return -1;
+	int page_bits = config->virtual_bits - config->offset_bits;
+	if (config->pt_levels < 1 || config->pt_levels > PT_MAX_LEVELS || page_bits < config->pt_levels) return -1;
+	if ((uint64_t)config->frames > (1ull << (config->physical_bits - config->offset_bits))) return -1;
+	if (config->write_batch <= 0 || config->write_batch > MAX_WRITE_BATCH) return -1;
+	if (config->policy == REPLACE_OPT && config->next_use == NULL) return -1;
+	if (config->prefetch < 0 || config->prefetch >= config->frames) return -1;
+	// superpage entries are told apart from page numbers by TLB_SUPERPAGE
+	if (config->superpage_bits < 0 || config->superpage_bits > SUPERPAGE_MAX_BITS || config->superpage_bits > page_bits) return -1;
+	if (config->superpage_bits && (page_bits > 30 || config->frames < 1 << config->superpage_bits)) return -1;
+	if (config->address_spaces <= 0 || config->frames <= 0 || config->policy < 0 || config->policy >= REPLACE_POLICIES) return -1;
+	if (config->l2_size < 0) return -1;
+	if (config->io_depth < 0 || (config->io_depth && (config->zero_copy || store->fd < 0))) return -1;
+	if (tlb_init(&vm->tlb, config->tlb_size, config->tlb_ways, config->tlb_policy) < 0) return -1;
+	if (config->l2_size && tlb_init(&vm->l2, config->l2_size, config->l2_ways, config->tlb_policy) < 0) {
+		tlb_free(&vm->tlb);
+		return -1;
+	}
+
+	vm->config = *config;
+	vm->offset_bits = config->offset_bits;
+	vm->page_size = 1u << config->offset_bits;
+	vm->offset_mask = vm->page_size - 1;
+	vm->virtual_pages = 1u << (config->virtual_bits - config->offset_bits);
+	vm->run = vm_run_kernel(config->offset_bits);
+	vm->batch = vm_batch_kernel(config->offset_bits);
+	vm->store = store;
+	vm->space = calloc(config->address_spaces, sizeof(struct vm_space));
+	vm->frame_owner = malloc(config->frames * sizeof(int));
+	vm->frame_asid = calloc(config->frames, sizeof(int));
+	vm->frame_data = malloc(config->frames * sizeof(signed char *));
+	if (config->zero_copy) {
+		// the page holding the end of the file, followed by a page of zeros for everything past it
+		vm->edge = calloc(2, vm->page_size);
+		if (vm->edge && store->size % vm->page_size) {
+			size_t start = store->size - store->size % vm->page_size;
+			memcpy(vm->edge, store->data + start, store->size - start);
+		}
+		// page faults touch the file at scattered places, so kernel read-ahead would be wasted
+		if (store->data) madvise(store->data, store->size, MADV_RANDOM);
+	} else {
+		vm->main_memory = malloc((size_t)config->frames * vm->page_size);
+	}
+	vm->dirty = calloc(config->frames, sizeof(uint8_t));
+	vm->prefetched = calloc(config->frames, sizeof(uint8_t));
+	vm->prefetch_pages = malloc((config->prefetch + 1) * sizeof(int));
+	vm->prefetch_frames = malloc((config->prefetch + 1) * sizeof(int));
+	vm->region_frames = malloc(sizeof(int) << config->superpage_bits);
+	vm->scratch = malloc(vm->page_size);
+	vm->wb_pages = malloc(config->write_batch * sizeof(int));
+	vm->wb_data = malloc((size_t)config->write_batch * vm->page_size);
+	if (!store->write_back) vm->store_written = calloc(store->size / vm->page_size + 1, sizeof(uint8_t));
+	if (!vm->space || !vm->frame_owner || !vm->frame_asid || !vm->frame_data || (config->zero_copy ? !vm->edge : !vm->main_memory) || !vm->dirty || !vm->prefetched || !vm->prefetch_pages || !vm->prefetch_frames || !vm->region_frames || !vm->scratch || !vm->wb_pages || !vm->wb_data || (!store->write_back && !vm->store_written)) {
+		perror("malloc");
+		exit(1);
+	}
+	for (int i = 0; i < config->address_spaces; i++) {
+		if (pt_init(&vm->space[i].pt, page_bits, config->pt_levels) < 0) {
+			// everything not set up yet is still zero, which vm_free skips
+			vm_free(vm);
+			return -1;
+		}
+		vm->space[i].last_fault = -1;
+		if (config->superpage_bits) {
+			size_t regions = vm->virtual_pages >> config->superpage_bits;
+			vm->space[i].resident = calloc(regions, sizeof(uint16_t));
+			vm->space[i].superpage = calloc(regions, sizeof(uint8_t));
+			if (!vm->space[i].resident || !vm->space[i].superpage) {
+				perror("calloc");
+				exit(1);
+			}
+		}
+	}
+	vm->pagetable = &vm->space[0].pt;
+	memset(vm->frame_owner, 0xff, config->frames * sizeof(int));
+	for (int i = 0; i < config->frames; i++) vm->frame_data[i] = config->zero_copy ? vm->edge + vm->page_size : vm->main_memory + (size_t)i * vm->page_size;
+	replacer_init(&vm->replacer, config->policy, config->frames);
+	vm->replacer.next_use = config->next_use;
+	if (config->io_depth) {
+		vm->io_slot = malloc(config->frames * sizeof(int));
+		vm->slot_frame = malloc(config->io_depth * sizeof(int));
+		if (!vm->io_slot || !vm->slot_frame) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(vm->io_slot, 0xff, config->frames * sizeof(int));
+		pagein_init(&vm->io, store->fd, config->io_depth);
+	}
+	return 0;
+}
+
+void vm_free(struct vm *vm)
+{
+	// reads still in flight fill frames, so they finish before main_memory goes
+	pagein_free(&vm->io);
+	free(vm->io_slot);
+	free(vm->slot_frame);
+	tlb_free(&vm->tlb);
+	tlb_free(&vm->l2);
+	replacer_free(&vm->replacer);
+	for (int i = 0; i < vm->config.address_spaces; i++) {
+		pt_free(&vm->space[i].pt);
+		free(vm->space[i].resident);
+		free(vm->space[i].superpage);
+	}
+	free(vm->space);
+	free(vm->frame_owner);
+	free(vm->frame_asid);
+	free(vm->main_memory);
+	free(vm->frame_data);
+	free(vm->edge);
+	free(vm->dirty);
+	free(vm->prefetched);
+	free(vm->prefetch_pages);
+	free(vm->prefetch_frames);
+	free(vm->region_frames);
+	free(vm->scratch);
+	free(vm->wb_pages);
+	free(vm->wb_data);
+	free(vm->store_written);
+	memset(vm, 0, sizeof(*vm));
+}
+
+static int compare_pages(const void *a, const void *b, void *pages)
+{
+	int pa = ((int *)pages)[*(const int *)a], pb = ((int *)pages)[*(const int *)b];
+	return (pa > pb) - (pa < pb);
+}
+
+/* Writes the pending batch to the backing store, one write per run of consecutive pages. */
+static void flush_write_backs(struct vm *vm)
+{
+	const struct backing_store *store = vm->store;
+	int order[MAX_WRITE_BATCH];
+	for (int i = 0; i < vm->wb_count; i++) order[i] = i;
+	qsort_r(order, vm->wb_count, sizeof(int), compare_pages, vm->wb_pages);
+
+	for (int i = 0; i < vm->wb_count;) {
+		int j = i + 1;
+		while (j < vm->wb_count && vm->wb_pages[order[j]] == vm->wb_pages[order[j - 1]] + 1) j++;
+		size_t start = (size_t)vm->wb_pages[order[i]] * vm->page_size;
+		if (store->write_back) {
+			struct iovec iov[MAX_WRITE_BATCH];
+			for (int k = i; k < j; k++) {
+				iov[k - i].iov_base = vm->wb_data + (size_t)order[k] * vm->page_size;
+				iov[k - i].iov_len = vm->page_size;
+			}
+			if (pwritev(store->fd, iov, j - i, start) < 0) perror("pwritev");
+		} else {
+			for (int k = i; k < j; k++) {
+				memcpy(store->data + start + (size_t)(k - i) * vm->page_size, vm->wb_data + (size_t)order[k] * vm->page_size, vm->page_size);
+				vm->store_written[vm->wb_pages[order[k]]] = 1;
+			}
+		}
+		vm->stats.write_back_ios++;
+		i = j;
+	}
+	vm->wb_count = 0;
+}
+
+/* Queues the dirty page in frame for writing back. Only pages inside the backing file are kept. */
+static void write_back(struct vm *vm, int frame, int logical_page)
+{
+	vm->dirty[frame] = 0;
+	vm->stats.write_backs++;
+	if ((size_t)(logical_page + 1) * vm->page_size > vm->store->size) return;
+	memcpy(vm->wb_data + (size_t)vm->wb_count * vm->page_size, vm->main_memory + (size_t)frame * vm->page_size, vm->page_size);
+	vm->wb_pages[vm->wb_count++] = logical_page;
+	if (vm->wb_count == vm->config.write_batch) flush_write_backs(vm);
+}
+
+void vm_sync(struct vm *vm)
+{
+	for (int frame = 0; frame < vm->config.frames; frame++) {
+		if (vm->dirty[frame]) write_back(vm, frame, vm->frame_owner[frame]);
+	}
+	if (vm->wb_count) flush_write_backs(vm);
+}
+
+/* Drops a mapping from both TLB levels. */
+static void tlb_invalidate_all(struct vm *vm, int asid, int tag)
+{
+	tlb_invalidate(&vm->tlb, asid, tag);
+	if (vm->config.l2_size) tlb_invalidate(&vm->l2, asid, tag);
+}
+
+/* Removes the page held in frame from pagetable and TLB. */
+static void evict_frame(struct vm *vm, int frame)
+{
+	if (vm->config.io_depth && vm->io_slot[frame] >= 0) vm_io_wait(vm, frame);
+	int victim = vm->frame_owner[frame];
+	if (victim != -1) {
+		if (vm->dirty[frame]) write_back(vm, frame, victim);
+		int asid = vm->frame_asid[frame];
+		pt_set(&vm->space[asid].pt, victim, -1);
+		tlb_invalidate_all(vm, asid, victim);
+		if (vm->prefetched[frame]) {
+			vm->prefetched[frame] = 0;
+			vm->stats.prefetch_wasted++;
+		}
+		if (vm->config.superpage_bits) {
+			struct vm_space *space = &vm->space[asid];
+			int region = victim >> vm->config.superpage_bits;
+			space->resident[region]--;
+			// the superpage loses a page, so it goes back to base pages
+			if (space->superpage[region]) {
+				space->superpage[region] = 0;
+				tlb_invalidate_all(vm, asid, TLB_SUPERPAGE | region);
+				vm->stats.demotions++;
+			}
+		}
+	}
+	vm->frame_owner[frame] = -1;
+}
+
+/* Records that frame holds logical_page of the running address space. */
+static void map_frame(struct vm *vm, int frame, int logical_page)
+{
+	pt_set(vm->pagetable, logical_page, frame);
+	vm->frame_owner[frame] = logical_page;
+	vm->frame_asid[frame] = vm->asid;
+	if (vm->config.superpage_bits) vm->space[vm->asid].resident[logical_page >> vm->config.superpage_bits]++;
+}
+
+/* Copies logical_page from the backing file into frame, or points the frame at it in zero-copy mode,
+ * and maps it. Pages past the end of the file read as zeros. */
+static void page_in(struct vm *vm, int frame, int logical_page)
+{
+	size_t start = (size_t)logical_page * vm->page_size;
+	size_t size = vm->store->size;
+	if (vm->config.zero_copy) {
+		if (start + vm->page_size <= size) vm->frame_data[frame] = vm->store->data + start;
+		else vm->frame_data[frame] = vm->edge + (start < size ? 0 : vm->page_size);
+		map_frame(vm, frame, logical_page);
+		return;
+	}
+	signed char *dst = vm->main_memory + (size_t)frame * vm->page_size;
+	// the store is stale while the page waits in the write-back batch
+	for (int i = 0; i < vm->wb_count; i++) {
+		if (vm->wb_pages[i] == logical_page) {
+			flush_write_backs(vm);
+			break;
+		}
+	}
+	if (vm->config.io_depth && start < size) {
+		// with depth reads in flight, the one started first has to finish to free a slot
+		int slot = pagein_submit(&vm->io, dst, vm->page_size, start);
+		if (slot == -1) {
+			vm_io_wait(vm, vm->slot_frame[pagein_oldest(&vm->io)]);
+			slot = pagein_submit(&vm->io, dst, vm->page_size, start);
+		}
+		vm->io_slot[frame] = slot;
+		vm->slot_frame[slot] = frame;
+		map_frame(vm, frame, logical_page);
+		return;
+	}
+	if (start + vm->page_size <= size) {
+		memcpy(dst, vm->store->data + start, vm->page_size);
+	} else {
+		memset(dst, 0, vm->page_size);
+		if (start < size) memcpy(dst, vm->store->data + start, size - start);
+	}
+	map_frame(vm, frame, logical_page);
+}
+
+/* Exchanges the pages held in frames a and b, both in use. */
+static void swap_frames(struct vm *vm, int a, int b)
+{
+	if (vm->config.io_depth) {
+		if (vm->io_slot[a] >= 0) vm_io_wait(vm, a);
+		if (vm->io_slot[b] >= 0) vm_io_wait(vm, b);
+	}
+	if (vm->config.zero_copy) {
+		signed char *data = vm->frame_data[a];
+		vm->frame_data[a] = vm->frame_data[b];
+		vm->frame_data[b] = data;
+	} else {
+		signed char *pa = vm->frame_data[a], *pb = vm->frame_data[b];
+		memcpy(vm->scratch, pa, vm->page_size);
+		memcpy(pa, pb, vm->page_size);
+		memcpy(pb, vm->scratch, vm->page_size);
+	}
+	int owner = vm->frame_owner[a], asid = vm->frame_asid[a];
+	vm->frame_owner[a] = vm->frame_owner[b];
+	vm->frame_asid[a] = vm->frame_asid[b];
+	vm->frame_owner[b] = owner;
+	vm->frame_asid[b] = asid;
+	uint8_t t = vm->dirty[a];
+	vm->dirty[a] = vm->dirty[b];
+	vm->dirty[b] = t;
+	t = vm->prefetched[a];
+	vm->prefetched[a] = vm->prefetched[b];
+	vm->prefetched[b] = t;
+	int frames[2] = {a, b};
+	for (int i = 0; i < 2; i++) {
+		int frame = frames[i];
+		pt_set(&vm->space[vm->frame_asid[frame]].pt, vm->frame_owner[frame], frame);
+		tlb_invalidate_all(vm, vm->frame_asid[frame], vm->frame_owner[frame]);
+	}
+	replacer_swap(&vm->replacer, a, b);
+	vm->stats.superpage_moves++;
+}
+
+/* Moves the pages of a fully resident region into one aligned block of frames, picking the block
+ * that already holds most of them in place. Returns the first frame of the block, or -1 if no
+ * block can be used yet. */
+static int promote(struct vm *vm, int region)
+{
+	int bits = vm->config.superpage_bits, pages = 1 << bits;
+	int first = region << bits;
+	int *frames = vm->region_frames;
+	uint64_t refs = 0;
+	for (int i = 0; i < pages; i++) frames[i] = pt_lookup(vm->pagetable, first + i, &refs);
+
+	// only blocks whose frames are all in use, so that free frames stay at the end
+	int in_use = vm->flag ? vm->config.frames : vm->free_page;
+	int best = -1, best_count = -1;
+	for (int i = 0; i < pages; i++) {
+		int block = frames[i] >> bits;
+		if ((block + 1) << bits > in_use) continue;
+		int count = 0;
+		for (int j = 0; j < pages; j++) count += frames[j] == (block << bits) + j;
+		if (count > best_count) {
+			best = block;
+			best_count = count;
+		}
+		if (count == pages) break;
+	}
+	if (best == -1) return -1;
+
+	int base = best << bits;
+	for (int i = 0; i < pages; i++) {
+		int target = base + i;
+		if (frames[i] == target) continue;
+		// the page moving out of target may be one of ours still to be placed
+		int owner = vm->frame_owner[target];
+		if (vm->frame_asid[target] == vm->asid && owner >> bits == region) frames[owner - first] = frames[i];
+		swap_frames(vm, frames[i], target);
+		frames[i] = target;
+	}
+	for (int i = 0; i < pages; i++) tlb_invalidate_all(vm, vm->asid, first + i);
+	vm->space[vm->asid].superpage[region] = 1;
+	vm->stats.promotions++;
+	return base;
+}
+
+int vm_superpage_map(struct vm *vm, int logical_page, int physical_page)
+{
+	struct vm_space *space = &vm->space[vm->asid];
+	int bits = vm->config.superpage_bits;
+	int region = logical_page >> bits, offset = logical_page & ((1 << bits) - 1);
+	if (!space->superpage[region] && space->resident[region] == 1 << bits) {
+		int base = promote(vm, region);
+		if (base != -1) physical_page = base + offset;
+		// the superpage entry covers frames that may still be read into
+		for (int i = 0; base != -1 && vm->config.io_depth && i < 1 << bits; i++) {
+			if (vm->io_slot[base + i] >= 0) vm_io_wait(vm, base + i);
+		}
+	}
+	if (space->superpage[region]) vm_tlb_insert(vm, TLB_SUPERPAGE | region, physical_page - offset);
+	else vm_tlb_insert(vm, logical_page, physical_page);
+	return physical_page;
+}
+
+/* Puts a mapping in L1. With an exclusive L2 the entry it replaces moves down to L2. */
+static void l1_fill(struct vm *vm, int tag, int physical_page)
+{
+	struct tlb *t = &vm->tlb;
+	int i = tlb_slot(t, vm->asid, tag);
+	if (vm->config.l2_exclusive && t->valid[i]) tlb_insert(&vm->l2, t->asid[i], t->logical[i], t->physical[i]);
+	tlb_set(t, i, vm->asid, tag, physical_page);
+}
+
+void vm_l2_insert(struct vm *vm, int tag, int physical_page)
+{
+	if (!vm->config.l2_exclusive) {
+		// L1 only holds what L2 holds, so an entry leaving L2 leaves L1 too
+		struct tlb *t = &vm->l2;
+		int i = tlb_slot(t, vm->asid, tag);
+		if (t->valid[i]) tlb_invalidate(&vm->tlb, t->asid[i], t->logical[i]);
+		tlb_set(t, i, vm->asid, tag, physical_page);
+	}
+	l1_fill(vm, tag, physical_page);
+}
+
+int vm_l2_lookup(struct vm *vm, int logical_page)
+{
+	int tag = logical_page;
+	int physical_page = tlb_lookup(&vm->l2, vm->asid, tag);
+	if (physical_page == -1 && vm->config.superpage_bits) {
+		tag = TLB_SUPERPAGE | (logical_page >> vm->config.superpage_bits);
+		physical_page = tlb_lookup(&vm->l2, vm->asid, tag);
+	}
+	if (physical_page == -1) return -1;
+	vm->stats.l2_hits++;
+	if (vm->config.l2_exclusive) tlb_invalidate(&vm->l2, vm->asid, tag);
+	l1_fill(vm, tag, physical_page);
+	if (tag == logical_page) return physical_page;
+	vm->stats.superpage_hits++;
+	physical_page += logical_page & ((1 << vm->config.superpage_bits) - 1);
+	vm_prefetch_used(vm, physical_page);
+	return physical_page;
+}
+
+int vm_parse_latency(const char *s, struct vm_latency *latency)
+{
+	struct vm_latency l = VM_LATENCY_DEFAULT;
+	double *fields[4] = {&l.tlb, &l.l2, &l.memory, &l.fault};
+	for (int i = 0; i < 4 && *s; i++) {
+		char *end;
+		*fields[i] = strtod(s, &end);
+		if (end == s || *fields[i] < 0 || (*end != ',' && *end != '\0')) return -1;
+		s = *end ? end + 1 : end;
+	}
+	if (*s || l.memory <= 0) return -1;
+	*latency = l;
+	return 0;
+}
+
+double vm_effective_access_time(const struct vm *vm)
+{
+	const struct vm_stats *s = &vm->stats;
+	const struct vm_latency *l = &vm->config.latency;
+	if (s->total_addresses == 0) return 0;
+	uint64_t l1_misses = s->total_addresses - (s->tlb_hits - s->l2_hits);
+	double time = s->total_addresses * (l->tlb + l->memory) + s->walk_refs * l->memory
+		+ (s->page_faults + s->write_back_ios) * l->fault;
+	if (vm->config.l2_size) time += l1_misses * l->l2;
+	return time / s->total_addresses;
+}
+
+uint64_t vm_tlb_reach(const struct vm *vm)
+{
+	uint64_t reach = 0;
+	for (int i = 0; i < vm->tlb.size; i++) {
+		if (!vm->tlb.valid[i]) continue;
+		reach += (vm->tlb.logical[i] & TLB_SUPERPAGE ? (uint64_t)1 << vm->config.superpage_bits : 1) * vm->page_size;
+	}
+	return reach;
+}
+
+void vm_switch(struct vm *vm, int asid)
+{
+	if (asid == vm->asid) return;
+	vm->asid = asid;
+	vm->pagetable = &vm->space[asid].pt;
+	vm->stats.context_switches++;
+	vm->space[asid].stats.context_switches++;
+}
+
+/* Returns a free frame, evicting the replacement victim once all frames are in use. */
+static int take_frame(struct vm *vm)
+{
+	int frame;
+	if (vm->flag) {
+		//page replacement
+		frame = replacer_victim(&vm->replacer);
+		evict_frame(vm, frame);
+	} else {
+		frame = vm->free_page++;
+		if (vm->free_page == vm->config.frames) vm->flag = 1;
+	}
+	return frame;
+}
+
+void vm_io_wait(struct vm *vm, int frame)
+{
+	ssize_t n = pagein_wait(&vm->io, vm->io_slot[frame]);
+	vm->io_slot[frame] = -1;
+	// the part past the end of the file reads as zeros
+	if (n < vm->page_size) memset(vm->frame_data[frame] + n, 0, vm->page_size - n);
+}
+
+int vm_fault_ahead(struct vm *vm, uint32_t logical_address)
+{
+	int logical_page = (logical_address >> vm->offset_bits) & (vm->virtual_pages - 1);
+	uint64_t refs = 0;
+	if (pt_lookup(vm->pagetable, logical_page, &refs) != -1) return 0;
+	// the translation that follows finds the page mapped, so the fault is counted here
+	vm->stats.page_faults++;
+	vm->space[vm->asid].stats.page_faults++;
+	int frame = vm_page_fault(vm, logical_page);
+	if (vm->config.prefetch) {
+		replacer_access(&vm->replacer, frame);
+		vm_prefetch(vm, logical_page);
+	}
+	return 1;
+}
+
+int vm_page_fault(struct vm *vm, int logical_page)
+{
+	int frame = take_frame(vm);
+	page_in(vm, frame, logical_page);
+	replacer_insert(&vm->replacer, frame);
+	return frame;
+}
+
+/* Asks the kernel to start reading logical_page of the backing file. */
+static void advise_willneed(struct vm *vm, int logical_page)
+{
+	size_t start = (size_t)logical_page * vm->page_size;
+	if (start >= vm->store->size) return;
+	size_t os_page = sysconf(_SC_PAGESIZE);
+	size_t aligned = start & ~(os_page - 1);
+	size_t end = start + vm->page_size < vm->store->size ? start + vm->page_size : vm->store->size;
+	madvise(vm->store->data + aligned, end - aligned, MADV_WILLNEED);
+}
+
+void vm_prefetch(struct vm *vm, int logical_page)
+{
+	struct vm_space *space = &vm->space[vm->asid];
+	int stride = logical_page - space->last_fault;
+	int confirmed = space->last_fault != -1 && stride != 0 && stride == space->fault_stride;
+	space->last_fault = logical_page;
+	space->fault_stride = stride;
+	if (!confirmed) return;
+
+	// Take every frame before filling any, so read-ahead pages never evict each other, nor the
+	// page that faulted, whatever the policy thinks of it. They go in cold, so later read-ahead
+	// recycles them before anything that was used.
+	uint64_t refs = 0;
+	vm->replacer.pinned = pt_lookup(vm->pagetable, logical_page, &refs);
+	int pages = 0;
+	int64_t page = logical_page;
+	for (int i = 0; i < vm->config.prefetch; i++) {
+		page += stride;
+		if (page < 0 || page >= vm->virtual_pages) break;
+		if (pt_lookup(vm->pagetable, page, &refs) != -1) continue;
+		vm->prefetch_pages[pages] = page;
+		vm->prefetch_frames[pages++] = take_frame(vm);
+	}
+	vm->replacer.pinned = -1;
+	for (int i = 0; i < pages; i++) {
+		int frame = vm->prefetch_frames[i];
+		page_in(vm, frame, vm->prefetch_pages[i]);
+		if (vm->config.zero_copy) advise_willneed(vm, vm->prefetch_pages[i]);
+		replacer_insert_cold(&vm->replacer, frame);
+		vm->prefetched[frame] = 1;
+		vm->stats.prefetches++;
+	}
+	// the stream's next fault is one stride past the read-ahead window
+	space->last_fault = logical_page + stride * vm->config.prefetch;
+}
+
@@ -0,0 +1,369 @@
+/**
+ * vm.h
+ *
+ * Virtual memory simulator instance: TLB, page table, physical frames and replacement state.
+ * Instances share nothing but the read-only backing store, so several can run at once.
+ * The engine is built into libvm.a for use outside part1/part2. It prints no results and returns
+ * bad arguments to the caller, but system failures go to stderr: failed opens and reads are
+ * reported with perror and returned, a failed write-back is reported and skipped, and running out
+ * of memory or threads, or a failed page read, exits the process.
+ */
+
+#ifndef VM_H
+#define VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tlb.h"
+#include "replace.h"
+#include "pagetable.h"
+#include "pagein.h"
+
+// 1 KiB pages unless configured otherwise
+#define OFFSET_BITS 10
+
+// vm_translate flags, same values as the binary output record flags
+#define VM_TLB_HIT 1
+#define VM_PAGE_FAULT 2
+
+// Largest superpage, 1 << SUPERPAGE_MAX_BITS pages.
+#define SUPERPAGE_MAX_BITS 9
+
+// Most pages a write-back batch can hold (one iovec each).
+#define MAX_WRITE_BATCH 1024
+
+// Latency model defaults in nanoseconds: L1 TLB, L2 TLB, memory reference, page fault service.
+#define VM_LATENCY_DEFAULT {1, 5, 100, 8000000}
+
+struct vm_latency {
+	// every translation pays tlb, L1 misses l2 as well, each page table entry read and each data access
+	// memory, and each page fault or write-back I/O fault
+	double tlb;
+	double l2;
+	double memory;
+	double fault;
+};
+
+struct backing_store {
+	signed char *data;
+	size_t size;
+	// kept open for write-back and for page reads with io_depth
+	int fd;
+	// set when dirty pages are written to the file, otherwise they only go to a private copy of it
+	int write_back;
+};
+
+struct vm_config {
+	// page size is 1 << offset_bits; logical addresses have virtual_bits bits (higher bits are ignored)
+	// and physical addresses physical_bits, both at most 32
+	int offset_bits;
+	int virtual_bits;
+	int physical_bits;
+	// number of physical frames, at most 1 << (physical_bits - offset_bits)
+	int frames;
+	enum replace_policy policy;
+	int tlb_size;
+	int tlb_ways;
+	enum tlb_policy tlb_policy;
+	// number of processes sharing the frames and the TLB, each with its own page table
+	int address_spaces;
+	// dirty pages collected before writing them back together (1 writes each one on eviction)
+	int write_batch;
+	// page table levels, 1 for a flat array
+	int pt_levels;
+	// pages read ahead when faults follow a fixed stride, 0 to disable
+	int prefetch;
+	// aligned groups of 1 << superpage_bits pages are promoted to one superpage once all are resident, 0 to disable
+	int superpage_bits;
+	// frames point into the mapped backing file instead of holding a copy; only for traces without writes
+	int zero_copy;
+	// REPLACE_OPT: replace_next_use of the addresses that will be translated, in order
+	const uint64_t *next_use;
+	// second level TLB entries (0 for none) and ways, with the replacement policy of the first; inclusive
+	// holds every L1 entry too, exclusive only takes entries evicted from L1
+	int l2_size;
+	int l2_ways;
+	int l2_exclusive;
+	// effective access time is reported when latency.memory is set
+	struct vm_latency latency;
+	// page-ins read the file with up to io_depth reads in flight instead of copying from the mapping, 0 to copy;
+	// not with zero_copy, and writes only reach these reads when the store writes back
+	int io_depth;
+};
+
+struct vm_stats {
+	uint64_t total_addresses;
+	uint64_t page_faults;
+	// TLB hits at either level, and of those the ones in the L2 TLB
+	uint64_t tlb_hits;
+	uint64_t l2_hits;
+	uint64_t context_switches;
+	uint64_t writes;
+	// dirty pages written back, and the writes to the backing store that took
+	uint64_t write_backs;
+	uint64_t write_back_ios;
+	// page table walks (one per TLB miss) and the table entries they read
+	uint64_t page_walks;
+	uint64_t walk_refs;
+	// pages read ahead, those referenced before eviction, and those evicted unused
+	uint64_t prefetches;
+	uint64_t prefetch_hits;
+	uint64_t prefetch_wasted;
+	// superpages formed and broken up, frames exchanged to make them contiguous, and TLB hits on superpage entries
+	uint64_t promotions;
+	uint64_t demotions;
+	uint64_t superpage_moves;
+	uint64_t superpage_hits;
+};
+
+struct vm_space {
+	// maps logical pages to physical pages, -1 if that logical page isn't yet in the table
+	struct pagetable pt;
+	struct vm_stats stats;
+	// stride detector: last faulting page and the distance to the fault before it
+	int last_fault;
+	int fault_stride;
+	// per superpage region: resident pages and whether it is mapped as a superpage
+	uint16_t *resident;
+	uint8_t *superpage;
+};
+
+struct vm;
+typedef void (*vm_run_fn)(struct vm *vm, const uint32_t *addrs, size_t n);
+typedef void (*vm_batch_fn)(struct vm *vm, const uint32_t *addrs, size_t n, uint32_t *out_phys, int8_t *out_vals);
+
+struct vm {
+	struct vm_config config;
+	// address geometry derived from config
+	int offset_bits;
+	uint32_t page_size;
+	uint32_t offset_mask;
+	uint32_t virtual_pages;
+	// vm_run and vm_translate_batch kernels specialized for this page size
+	vm_run_fn run;
+	vm_batch_fn batch;
+	const struct backing_store *store;
+	struct tlb tlb;
+	// second level TLB, size 0 if config.l2_size is 0
+	struct tlb l2;
+	// one page table per address space; asid is the running one and pagetable its table
+	struct vm_space *space;
+	int asid;
+	struct pagetable *pagetable;
+	// frame_owner[physical_page] is the logical page held in that frame, -1 if the frame is free,
+	// and frame_asid[physical_page] the address space it belongs to.
+	int *frame_owner;
+	int *frame_asid;
+	// frame_data[physical_page] is the memory of that frame: a slot of main_memory, or with
+	// zero_copy the page of the mapped file (main_memory is then not allocated)
+	signed char **frame_data;
+	signed char *main_memory;
+	// zero_copy: copy of the partial last page of the file, then a page of zeros
+	signed char *edge;
+	// dirty[physical_page] is set when the frame was written since it was loaded
+	uint8_t *dirty;
+	// prefetched[physical_page] is set while a read-ahead page has not been referenced
+	uint8_t *prefetched;
+	// pages being read ahead and the frames taken for them
+	int *prefetch_pages;
+	int *prefetch_frames;
+	// frames of the region being promoted and a page buffer for moving pages between frames
+	int *region_frames;
+	signed char *scratch;
+	// evicted dirty pages waiting to be written back, wb_data holds their contents
+	int *wb_pages;
+	signed char *wb_data;
+	int wb_count;
+	// without write_back: store_written[logical_page] is set once a write-back changed that page of the private copy
+	uint8_t *store_written;
+	struct replacer replacer;
+	// io_depth: io_slot[physical_page] is the read filling that frame, -1 once its data is there,
+	// and slot_frame[slot] the frame a read fills
+	struct pagein io;
+	int *io_slot;
+	int *slot_frame;
+	// Number of the next unallocated physical page, flag is set once all frames are in use
+	int free_page;
+	int flag;
+	struct vm_stats stats;
+};
+
+/* Maps the backing store file. With write_back set, dirty pages are written to the file;
+ * otherwise they go to a private copy-on-write mapping. Returns 0 on success, -1 on error. */
+int backing_open(struct backing_store *store, const char *path, int write_back);
+void backing_close(struct backing_store *store);
+
+/* Parses a page size such as "1024", "4K" or "2M". Returns log2 of it, or -1 if it is not a power of two. */
+int vm_parse_page_size(const char *s);
+
+/* Parses a number of pages per superpage. Returns log2 of it (0 for 0 or 1, which turn superpages off),
+ * or -1 if it is not a power of two. */
+int vm_parse_superpage(const char *s);
+
+/* Creates an empty instance. Returns 0 on success, -1 on an invalid configuration. */
+int vm_init(struct vm *vm, const struct vm_config *config, const struct backing_store *store);
+void vm_free(struct vm *vm);
+
+/* Makes asid the running address space. TLB entries are tagged, so nothing is flushed. */
+void vm_switch(struct vm *vm, int asid);
+
+/* Loads logical_page into a free or evicted frame and returns the frame. */
+int vm_page_fault(struct vm *vm, int logical_page);
+
+/* Waits for the read filling frame, which must have one outstanding. */
+void vm_io_wait(struct vm *vm, int frame);
+
+/* With io_depth, starts the page-in for logical_address if its page is not resident, counting the fault,
+ * and returns 1; the read then overlaps whatever runs before the address is translated. Returns 0 if resident. */
+int vm_fault_ahead(struct vm *vm, uint32_t logical_address);
+
+/* Called after a fault on logical_page. If the last faults were a fixed stride apart,
+ * reads ahead config.prefetch pages along it. */
+void vm_prefetch(struct vm *vm, int logical_page);
+
+/* Maps logical_page after a TLB miss: inserts a base page entry, or a superpage entry if its region is
+ * (or can now be) promoted. Returns the frame of logical_page, which promotion may have moved. */
+int vm_superpage_map(struct vm *vm, int logical_page, int physical_page);
+
+/* Counts the first use of a read-ahead page held in frame. */
+static inline void vm_prefetch_used(struct vm *vm, int frame)
+{
+	if (vm->prefetched[frame]) {
+		vm->prefetched[frame] = 0;
+		vm->stats.prefetch_hits++;
+	}
+}
+
+/* Looks logical_page up in the superpage entries of TLB t. Returns its frame or -1. */
+static inline int vm_superpage_lookup(struct vm *vm, struct tlb *t, int logical_page)
+{
+	int bits = vm->config.superpage_bits;
+	int base = tlb_lookup(t, vm->asid, TLB_SUPERPAGE | (logical_page >> bits));
+	if (base == -1) return -1;
+	vm->stats.superpage_hits++;
+	// a superpage entry covers read-ahead pages that were never used through a page walk
+	int frame = base + (logical_page & ((1 << bits) - 1));
+	vm_prefetch_used(vm, frame);
+	return frame;
+}
+
+/* Looks logical_page up in the L2 TLB after an L1 miss, moving the entry it finds to L1.
+ * Returns the frame or -1. */
+int vm_l2_lookup(struct vm *vm, int logical_page);
+
+/* Inserts a mapping (tag is a page or TLB_SUPERPAGE | region) into both TLB levels as the inclusion policy says. */
+void vm_l2_insert(struct vm *vm, int tag, int physical_page);
+
+/* Returns the frame of logical_page from the TLBs or -1 on a miss. */
+static inline int vm_tlb_lookup(struct vm *vm, int logical_page)
+{
+	int physical_page = tlb_lookup(&vm->tlb, vm->asid, logical_page);
+	if (physical_page == -1 && vm->config.superpage_bits) physical_page = vm_superpage_lookup(vm, &vm->tlb, logical_page);
+	if (physical_page == -1 && vm->config.l2_size) physical_page = vm_l2_lookup(vm, logical_page);
+	return physical_page;
+}
+
+static inline void vm_tlb_insert(struct vm *vm, int tag, int physical_page)
+{
+	if (vm->config.l2_size) vm_l2_insert(vm, tag, physical_page);
+	else tlb_insert(&vm->tlb, vm->asid, tag, physical_page);
+}
+
+/* Parses latencies "tlb,l2,memory,fault" in nanoseconds; fields left out keep VM_LATENCY_DEFAULT.
+ * Returns 0, or -1 if s is malformed. */
+int vm_parse_latency(const char *s, struct vm_latency *latency);
+
+/* Mean time per translated address under config.latency, in nanoseconds. */
+double vm_effective_access_time(const struct vm *vm);
+
+/* Bytes of address space covered by the valid TLB entries. */
+uint64_t vm_tlb_reach(const struct vm *vm);
+
+/* Translation with the page size passed in, so that callers with a constant offset_bits
+ * get a kernel with constant shifts and masks. */
+static inline __attribute__((always_inline)) uint32_t vm_translate_bits(struct vm *vm, uint32_t logical_address,
+	unsigned *flags, int offset_bits)
+{
+	uint32_t offset = logical_address & ((1u << offset_bits) - 1);
+	int logical_page = (logical_address >> offset_bits) & (vm->virtual_pages - 1);
+	struct vm_stats *space_stats = &vm->space[vm->asid].stats;
+	vm->stats.total_addresses++;
+	space_stats->total_addresses++;
+
+	int physical_page = vm_tlb_lookup(vm, logical_page);
+	// TLB hit
+	if (physical_page != -1) {
+		vm->stats.tlb_hits++;
+		space_stats->tlb_hits++;
+		*flags |= VM_TLB_HIT;
+	// TLB miss
+	} else {
+		vm->stats.page_walks++;
+		physical_page = pt_lookup(vm->pagetable, logical_page, &vm->stats.walk_refs);
+		int fault = physical_page == -1;
+		// Page fault
+		if (fault) {
+			vm->stats.page_faults++;
+			space_stats->page_faults++;
+			*flags |= VM_PAGE_FAULT;
+			physical_page = vm_page_fault(vm, logical_page);
+		// read-ahead pages are not put in the TLB as base pages, so their first use comes through here
+		// or through a superpage entry
+		} else {
+			vm_prefetch_used(vm, physical_page);
+		}
+		if (vm->config.superpage_bits) physical_page = vm_superpage_map(vm, logical_page, physical_page);
+		else vm_tlb_insert(vm, logical_page, physical_page);
+		if (vm->config.io_depth && vm->io_slot[physical_page] >= 0) vm_io_wait(vm, physical_page);
+		if (fault && vm->config.prefetch) {
+			// the read-ahead that follows holds this frame out of replacement
+			replacer_access(&vm->replacer, physical_page);
+			vm_prefetch(vm, logical_page);
+			return ((uint32_t)physical_page << offset_bits) | offset;
+		}
+	}
+	replacer_access(&vm->replacer, physical_page);
+	return ((uint32_t)physical_page << offset_bits) | offset;
+}
+
+/* Translates logical_address and returns the physical address. Sets VM_* bits in *flags. */
+static inline uint32_t vm_translate(struct vm *vm, uint32_t logical_address, unsigned *flags)
+{
+	return vm_translate_bits(vm, logical_address, flags, vm->offset_bits);
+}
+
+/* Returns the byte at physical_address. */
+static inline signed char vm_load(const struct vm *vm, uint32_t physical_address)
+{
+	return vm->frame_data[physical_address >> vm->offset_bits][physical_address & vm->offset_mask];
+}
+
+/* Translates logical_address and stores value there, marking the frame dirty. Not for zero_copy instances. */
+static inline uint32_t vm_write(struct vm *vm, uint32_t logical_address, signed char value, unsigned *flags)
+{
+	uint32_t physical_address = vm_translate(vm, logical_address, flags);
+	vm->main_memory[physical_address] = value;
+	vm->dirty[physical_address >> vm->offset_bits] = 1;
+	vm->stats.writes++;
+	vm->space[vm->asid].stats.writes++;
+	return physical_address;
+}
+
+/* Writes back every dirty frame and any pending batch. */
+void vm_sync(struct vm *vm);
+
+/* Translates n addresses, only counting statistics. */
+static inline void vm_run(struct vm *vm, const uint32_t *addrs, size_t n)
+{
+	vm->run(vm, addrs, n);
+}
+
+/* Translates n addresses into out_phys and, unless out_vals is NULL, the byte at each one
+ * into out_vals. Same counting as vm_translate, without a call per address. */
+static inline void vm_translate_batch(struct vm *vm, const uint32_t *addrs, size_t n, uint32_t *out_phys, int8_t *out_vals)
+{
+	vm->batch(vm, addrs, n, out_phys, out_vals);
+}
+
+#endif
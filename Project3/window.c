@@ -0,0 +1,72 @@
+/**
+ * window.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "window.h"
+
+int window_open(struct window *w, const char *path, uint64_t length, const struct vm *vm)
+{
+	memset(w, 0, sizeof(*w));
+	if (length == 0) return -1;
+	size_t n = strlen(path);
+	w->format = n >= 5 && strcmp(path + n - 5, ".json") == 0 ? WINDOW_JSON : WINDOW_CSV;
+	w->length = length;
+	w->offset_bits = vm->offset_bits;
+	w->page_bits = vm->config.virtual_bits - vm->offset_bits;
+	w->page_mask = vm->virtual_pages - 1;
+	w->last_use = calloc((size_t)vm->config.address_spaces << w->page_bits, sizeof(uint64_t));
+	if (w->last_use == NULL) {
+		perror("calloc");
+		return -1;
+	}
+	w->fp = fopen(path, "w");
+	if (w->fp == NULL) {
+		perror(path);
+		free(w->last_use);
+		return -1;
+	}
+	if (w->format == WINDOW_CSV) {
+		fprintf(w->fp, "window,start,addresses,fault_rate,tlb_hit_rate,working_set,cold");
+		for (int i = 0; i < REUSE_BUCKETS; i++) fprintf(w->fp, ",reuse_%llu", 1ull << i);
+		fprintf(w->fp, "\n");
+	} else {
+		fprintf(w->fp, "[");
+	}
+	return 0;
+}
+
+/* Writes the current window and starts the next one. */
+void window_flush(struct window *w)
+{
+	uint64_t n = w->position - w->start;
+	double rate = n ? 1. / n : 0;
+	if (w->format == WINDOW_CSV) {
+		fprintf(w->fp, "%llu,%llu,%llu,%.4f,%.4f,%llu,%llu", (unsigned long long)w->number, (unsigned long long)w->start,
+			(unsigned long long)n, w->faults * rate, w->tlb_hits * rate, (unsigned long long)w->working_set, (unsigned long long)w->cold);
+		for (int i = 0; i < REUSE_BUCKETS; i++) fprintf(w->fp, ",%llu", (unsigned long long)w->reuse[i]);
+		fprintf(w->fp, "\n");
+	} else {
+		fprintf(w->fp, "%s\n{\"window\": %llu, \"start\": %llu, \"addresses\": %llu, \"fault_rate\": %.4f, \"tlb_hit_rate\": %.4f, \"working_set\": %llu, \"cold\": %llu, \"reuse\": [",
+			w->number ? "," : "", (unsigned long long)w->number, (unsigned long long)w->start, (unsigned long long)n,
+			w->faults * rate, w->tlb_hits * rate, (unsigned long long)w->working_set, (unsigned long long)w->cold);
+		for (int i = 0; i < REUSE_BUCKETS; i++) fprintf(w->fp, "%s%llu", i ? ", " : "", (unsigned long long)w->reuse[i]);
+		fprintf(w->fp, "]}");
+	}
+	w->number++;
+	w->start = w->position;
+	w->faults = w->tlb_hits = w->working_set = w->cold = 0;
+	memset(w->reuse, 0, sizeof(w->reuse));
+}
+
+void window_close(struct window *w)
+{
+	if (w->position > w->start) window_flush(w);
+	if (w->format == WINDOW_JSON) fprintf(w->fp, "\n]\n");
+	if (fclose(w->fp) != 0) perror("window");
+	free(w->last_use);
+	memset(w, 0, sizeof(*w));
+}
@@ -0,0 +1,82 @@
+/**
+ * window.h
+ *
+ * Time-windowed statistics of a simulation: fault rate, TLB hit rate, working set size and a
+ * reuse distance histogram per window of a fixed number of addresses, written as CSV or JSON.
+ * Only counters are updated per address.
+ */
+
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vm.h"
+
+// Addresses per window unless configured otherwise.
+#define WINDOW_LENGTH 10000
+// The reuse distance of a reference is the number of references since the last one to the same page
+// (a time distance; -m mrc in part2 gives LRU stack distances). Bucket i counts distances in [2^i, 2^(i+1)); the last one everything above.
+#define REUSE_BUCKETS 24
+
+enum window_format {
+	WINDOW_CSV,
+	WINDOW_JSON
+};
+
+struct window {
+	enum window_format format;
+	FILE *fp;
+	uint64_t length;
+	// addresses seen so far and the index of the first one of the current window
+	uint64_t position;
+	uint64_t start;
+	uint64_t number;
+	// page geometry of the simulator, pages of address space a are numbered from a << page_bits
+	int offset_bits;
+	int page_bits;
+	uint32_t page_mask;
+	// last_use[page] is 1 + the position of the last reference to page, 0 if never referenced
+	uint64_t *last_use;
+	// current window: faults, TLB hits, distinct pages, first references and the reuse histogram
+	uint64_t faults;
+	uint64_t tlb_hits;
+	uint64_t working_set;
+	uint64_t cold;
+	uint64_t reuse[REUSE_BUCKETS];
+};
+
+/* Opens path for the windows of vm, JSON if path ends in ".json" and CSV otherwise.
+ * Returns 0 on success, -1 on error. */
+int window_open(struct window *w, const char *path, uint64_t length, const struct vm *vm);
+
+/* Writes the last, partial window and closes the file. */
+void window_close(struct window *w);
+
+void window_flush(struct window *w);
+
+/* Records a translation of logical_address in address space asid with the VM_* flags it got. */
+static inline void window_record(struct window *w, int asid, uint32_t logical_address, unsigned flags)
+{
+	uint64_t page = ((uint64_t)asid << w->page_bits) | ((logical_address >> w->offset_bits) & w->page_mask);
+	uint64_t last = w->last_use[page];
+	w->position++;
+	w->last_use[page] = w->position;
+	if (last == 0) {
+		w->cold++;
+		w->working_set++;
+	} else {
+		uint64_t distance = w->position - last;
+		int bucket = 63 - __builtin_clzll(distance);
+		w->reuse[bucket < REUSE_BUCKETS ? bucket : REUSE_BUCKETS - 1]++;
+		// first reference in this window
+		if (last <= w->start) w->working_set++;
+	}
+	w->faults += (flags & VM_PAGE_FAULT) != 0;
+	w->tlb_hits += (flags & VM_TLB_HIT) != 0;
+	if (w->position - w->start == w->length) window_flush(w);
+}
+
+#endif